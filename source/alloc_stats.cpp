@@ -0,0 +1,156 @@
+#include "alloc_stats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include "mywindows.h"
+#include <psapi.h>
+#endif // _WIN32
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif // __linux__
+
+namespace {
+
+// plain globals, not function statics, operator new can run before main
+std::atomic<bool> counting {false};
+std::atomic<uint64> allocations {0};
+std::atomic<uint64> bytes {0};
+std::atomic<uint64> freetype_allocations {0};
+std::atomic<uint64> freetype_bytes {0};
+
+void count(std::atomic<uint64>& counter, std::atomic<uint64>& byte_counter, const std::size_t size) noexcept
+{
+    counter.fetch_add(1, std::memory_order_relaxed);
+    byte_counter.fetch_add(size, std::memory_order_relaxed);
+}
+
+void* aligned_malloc(const std::size_t size, const std::size_t alignment) noexcept
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment); // a multiple of it
+#endif // _WIN32
+}
+
+void aligned_free(void* p) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif // _WIN32
+}
+
+// what every form of operator new does, 'alignment' is 0 for the ones without std::align_val_t
+void* allocate(std::size_t size, const std::size_t alignment)
+{
+    if(counting.load(std::memory_order_relaxed)) count(allocations, bytes, size);
+    if(size == 0) size = 1;
+    while(true) {
+        if(void* p = alignment == 0 ? std::malloc(size) : aligned_malloc(size, alignment)) return p;
+        std::new_handler handler = std::get_new_handler();
+        if(not handler) throw std::bad_alloc {};
+        handler();
+    }
+}
+
+void* allocate_nothrow(const std::size_t size, const std::size_t alignment) noexcept
+{
+    try { return allocate(size, alignment); }
+    catch(const std::bad_alloc&) { return nullptr; }
+}
+
+} // namespace
+
+/* Every form is replaced, so that each allocation is counted and each block goes back to the
+function that allocated it: the library's nothrow or aligned forms would otherwise be paired with
+these deletes (std::stable_sort allocates its buffer with the nothrow new, for example). */
+void* operator new(std::size_t size) { return allocate(size, 0); }
+void* operator new[](std::size_t size) { return allocate(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate_nothrow(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return allocate_nothrow(size, static_cast<std::size_t>(alignment)); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { aligned_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { aligned_free(p); }
+
+void enable_alloc_counting() noexcept
+{
+    counting = true;
+}
+
+Alloc_counters read_alloc_counters() noexcept
+{
+    return {allocations.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed),
+            freetype_allocations.load(std::memory_order_relaxed), freetype_bytes.load(std::memory_order_relaxed)};
+}
+
+void count_freetype_allocation(const std::size_t size) noexcept
+{
+    if(counting.load(std::memory_order_relaxed)) count(freetype_allocations, freetype_bytes, size);
+}
+
+std::size_t peak_rss() noexcept
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(not GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+#endif // _WIN32
+
+#ifdef __linux__
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == -1) return 0;
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // in KiB
+#endif // __linux__
+}
+
+void Alloc_report::begin_phase(const char* name)
+{
+    end_phase();
+    m_phases.push_back({name, read_alloc_counters(), {}, 0});
+}
+
+void Alloc_report::end_phase()
+{
+    if(m_phases.empty()) return;
+    m_phases.back().end = read_alloc_counters();
+    m_phases.back().peak_rss = peak_rss();
+}
+
+/* Report format, one line per phase:
+<phase>:<allocations>:<bytes>:<FreeType allocations>:<FreeType bytes>:<peak RSS in KiB at the end of the phase>
+*/
+std::string Alloc_report::finish()
+{
+    end_phase();
+    std::string report;
+    for(const Phase& phase : m_phases) {
+        report.append(phase.name);
+        report.append(1, ':').append(std::to_string(phase.end.allocations - phase.start.allocations));
+        report.append(1, ':').append(std::to_string(phase.end.bytes - phase.start.bytes));
+        report.append(1, ':').append(std::to_string(phase.end.freetype_allocations - phase.start.freetype_allocations));
+        report.append(1, ':').append(std::to_string(phase.end.freetype_bytes - phase.start.freetype_bytes));
+        report.append(1, ':').append(std::to_string(phase.peak_rss / 1024)).append(1, '\n');
+    }
+    return report;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "mystdint.hpp"
+
+/*
+Allocation accounting (-alloc-stats). Every form of the program's global operator new and delete
+(plain, array, nothrow, aligned and sized) is replaced by one that counts the allocations made
+through it, and the FreeType memory pool counts the allocations it can't serve from its free lists
+with count_freetype_allocation(). Nothing is counted until enable_alloc_counting() is called, so
+the cost of the hooks is a relaxed atomic load when the accounting is off.
+*/
+
+struct Alloc_counters {
+    uint64 allocations = 0; // any form of operator new
+    uint64 bytes = 0;
+    uint64 freetype_allocations = 0; // the ones that reached malloc, see Ft_memory_pool
+    uint64 freetype_bytes = 0;
+};
+
+void enable_alloc_counting() noexcept;
+Alloc_counters read_alloc_counters() noexcept;
+void count_freetype_allocation(const std::size_t size) noexcept;
+// the highest resident set size (working set on Windows) of the process so far, in bytes
+std::size_t peak_rss() noexcept;
+
+// the counters of consecutive phases of a run, each phase lasts until the next one begins
+class Alloc_report {
+public:
+    void begin_phase(const char* name);
+    // ends the last phase and returns one line per phase
+    std::string finish();
+private:
+    struct Phase {
+        const char* name;
+        Alloc_counters start;
+        Alloc_counters end;
+        std::size_t peak_rss;
+    };
+    void end_phase();
+
+    std::vector<Phase> m_phases;
+};
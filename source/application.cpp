@@ -3,13 +3,21 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cstdio>
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <vector>
 #include <map>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 #include <algorithm>
 #include <cstdlib>
 #include <utility>
+#include <iterator>
+#include <thread>
+#include <atomic>
 #include "mystdint.hpp"
 
 #ifdef _WIN32
@@ -20,6 +28,23 @@
 #include "png.h"
 
 #include "maxrects.hpp"
+#include "server.hpp"
+#include "coverage.hpp"
+#include "charfile.hpp"
+#include "kerning.hpp"
+#include "sdf.hpp"
+#include "msdf.hpp"
+#include "alloc_stats.hpp"
+#include "atlas_strips.hpp"
+#include "progress.hpp"
+
+#include FT_MODULE_H
+#include FT_OUTLINE_H
+#include FT_LCD_FILTER_H
+
+// part of the input hash, so outputs of a different version are never reused
+constexpr const char* program_version = "1.1.0";
+
 bool compare_rects(const Rect& lhs, const Rect& rhs) noexcept
 {
     return lhs.area() > rhs.area();
@@ -49,7 +74,7 @@ std::filesystem::path get_exe_dir() noexcept
 }
 
 /* List of available cli arguments:
--font
+-font // one font file, or a comma separated fallback chain of font files
 -font-size
 -image-size
 -char-file
@@ -59,19 +84,60 @@ std::filesystem::path get_exe_dir() noexcept
 -as-given
 -multiple-images
 -sdf // signed distance fields
+-update // append new glyphs to the atlases of a previous run
+-force // regenerate the files even if the inputs didn't change
+-serve // answer glyph requests from stdin, or from a Unix domain socket if given a value
+-sdf-engine // freetype or native
+-sdf-spread
+-msdf // multi-channel signed distance fields
+-dedup-bitmaps // characters with identical bitmaps share one place in the atlas
+-coverage // check a list of fonts against a list of characters files
+-ranges // code point ranges and presets, added to the characters of -char-file
+-kerning // write the non-zero kerning pairs of the characters to <stem>-kerning.txt
+-subpixel // number of horizontal subpixel offsets each glyph is rendered at
+-lcd // LCD subpixel rendering into RGB atlases
+-lcd-filter // default, light, legacy or none
+-max-memory // in MiB, atlases are generated and encoded strip by strip, only a band of rows is in memory
+-alloc-stats // print the allocations and the peak memory of each phase of the run
+-glyph-ids // all, or a file of glyph indices: glyphs are taken by index instead of by character
+-allow-rotation // the packer may turn glyphs 90 degrees clockwise
+-packer-stats // print how the packer behaved and write it to <stem>-packer-stats.txt
+-parallel-pack // with -multiple-images, pack several atlases at once
+-heuristic // area, short-side, long-side or top-left: how the packer picks a free rectangle
+-progress // write a status line to stderr every second
 */
 
 struct Cli_args {
     std::string font_file;
+    std::vector<std::string> font_files; // -font split at the commas
     std::string char_file;
+    std::string ranges;
+    std::string glyph_ids;
     std::string output_stem;
     int font_size = 32;
     int image_size = 256; // enough for standard ASCII
+    int sdf_spread = 8; // FreeType's default
+    int subpixel = 1; // a single variant, at whole pixels
+    int lcd_filter = FT_LCD_FILTER_DEFAULT;
+    int max_memory = 0; // in MiB, 0 means no limit
+    int heuristic = 0; // index in 'heuristics'
     bool load_vert_metrics = false;
     bool as_given = false;
     bool multiple_images = false;
     bool sdf = false;
     bool verify = false;
+    bool update = false;
+    bool force = false;
+    bool native_sdf = false;
+    bool msdf = false;
+    bool dedup_bitmaps = false;
+    bool kerning = false;
+    bool lcd = false;
+    bool alloc_stats = false;
+    bool allow_rotation = false;
+    bool packer_stats = false;
+    bool parallel_pack = false;
+    bool progress = false;
 };
 
 struct Char_info {
@@ -82,13 +148,112 @@ struct Char_info {
     int top_bearing = 0;
     int advance_x = 0;
     int advance_y = 0;
+    int face = 0; // which font of the fallback chain contains the glyph
 };
 
+// the links and colour of a std::map node and its key, on top of the mapped value
+constexpr std::size_t map_node_overhead = 4 * sizeof(void*);
+
+// 64-bit FNV-1a
+uint64 hash_bytes(uint64 hash, const void* data, const std::size_t size) noexcept
+{
+    const uint8* bytes = static_cast<const uint8*>(data);
+    for(std::size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+uint64 hash_string(const uint64 hash, const std::string_view str) noexcept
+{
+    const uint64 size = str.size(); // the size keeps "ab"+"c" and "a"+"bc" apart
+    return hash_bytes(hash_bytes(hash, &size, sizeof(size)), str.data(), str.size());
+}
+
+// every field of Cli_args that affects the generated files must be hashed here
+uint64 hash_inputs(const Cli_args& cli_args, const std::vector<std::vector<uint8>>& font_files, const std::string_view char_file,
+                   const std::string_view glyph_id_file) noexcept
+{
+    uint64 hash = 0xCBF29CE484222325ull;
+    hash = hash_string(hash, program_version);
+    hash = hash_string(hash, cli_args.font_file);
+    hash = hash_string(hash, cli_args.char_file);
+    hash = hash_string(hash, cli_args.ranges);
+    hash = hash_string(hash, cli_args.glyph_ids);
+    hash = hash_string(hash, cli_args.output_stem);
+    const int32 numbers[] {cli_args.font_size, cli_args.image_size, cli_args.sdf_spread, cli_args.subpixel, cli_args.lcd_filter, cli_args.heuristic};
+    hash = hash_bytes(hash, numbers, sizeof(numbers));
+    const bool flags[] {cli_args.load_vert_metrics, cli_args.as_given, cli_args.multiple_images, cli_args.sdf, cli_args.update, cli_args.native_sdf, cli_args.msdf, cli_args.dedup_bitmaps, cli_args.kerning, cli_args.lcd,
+                       cli_args.allow_rotation, cli_args.parallel_pack};
+    hash = hash_bytes(hash, flags, sizeof(flags));
+    for(const std::vector<uint8>& font_file : font_files) {
+        const uint64 font_file_size = font_file.size();
+        hash = hash_bytes(hash, &font_file_size, sizeof(font_file_size));
+        hash = hash_bytes(hash, font_file.data(), font_file.size());
+    }
+    hash = hash_string(hash, char_file);
+    hash = hash_string(hash, glyph_id_file);
+    return hash;
+}
+
+std::string hash_to_string(const uint64 hash)
+{
+    constexpr const char* digits = "0123456789abcdef";
+    std::string str(16, '0');
+    for(int i = 0; i < 16; ++i) str[15 - i] = digits[(hash >> (i * 4)) & 0xF];
+    return str;
+}
+
 bool valid_arg_index(const int index, const int max_index) noexcept
 {
     return not (index > max_index);
 }
 
+std::vector<std::string> split_font_list(const std::string& font_list)
+{
+    std::vector<std::string> font_files;
+    std::size_t begin = 0;
+    while(true) {
+        const std::size_t end = font_list.find(',', begin);
+        font_files.push_back(font_list.substr(begin, end - begin));
+        if(end == std::string::npos) break;
+        begin = end + 1;
+    }
+    return font_files;
+}
+
+// "the character #2 in the line #5", or "the character U+4E00 of -ranges", for error messages
+std::string describe_character(const Char_file_entry& entry)
+{
+    if(entry.line_number != 0) {
+        return "the character #" + std::to_string(entry.char_number) + " in the line #" + std::to_string(entry.line_number);
+    }
+    constexpr const char* digits = "0123456789ABCDEF";
+    std::string hex;
+    for(uint32 cp = entry.code_point; cp != 0 or hex.size() < 4; cp >>= 4) hex.insert(hex.begin(), digits[cp & 0xF]);
+    return "the character U+" + hex + " of -ranges";
+}
+
+// index of the first face of the fallback chain that contains 'code_point', -1 if none does
+int find_face(const std::vector<FT_Face>& faces, const char32_t code_point, FT_UInt& glyph_index) noexcept
+{
+    for(std::size_t i = 0; i < faces.size(); ++i) {
+        glyph_index = FT_Get_Char_Index(faces[i], code_point);
+        if(glyph_index != 0) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+// the character codes of the face's charmap, walking it doesn't load any glyph
+uint64 count_char_codes(FT_Face face) noexcept
+{
+    uint64 count = 0;
+    FT_UInt glyph_index = 0;
+    for(FT_ULong charcode = FT_Get_First_Char(face, &glyph_index); glyph_index != 0; charcode = FT_Get_Next_Char(face, charcode, &glyph_index)) ++count;
+    return count;
+}
+
 std::filesystem::path create_output_filename(const std::string& output_stem, const int bin_instance, const bool image_type) noexcept
 {
     std::filesystem::path p {get_exe_dir()};
@@ -100,7 +265,206 @@ std::filesystem::path create_output_filename(const std::string& output_stem, con
     return p;
 }
 
-void place_char_info(std::ofstream& info_file, const Rect& rect_info, const Char_info& char_info)
+std::filesystem::path create_output_filename(const std::string& output_stem, const char* suffix) noexcept
+{
+    std::filesystem::path p {get_exe_dir()};
+    if(p.empty()) return p;
+    std::string s {"output/"};
+    s.append(output_stem).append(suffix);
+    p.append(s);
+    return p;
+}
+
+// the stamp file holds the input hash followed by the names of the generated files
+bool outputs_up_to_date(const std::filesystem::path& stamp_path, const std::string& hash)
+{
+    std::ifstream stamp_file {stamp_path, std::ios_base::binary};
+    if(not stamp_file) return false;
+    std::string line;
+    if(not std::getline(stamp_file, line) or line != hash) return false;
+    std::error_code ec;
+    while(std::getline(stamp_file, line)) {
+        if(line.empty()) continue;
+        if(not std::filesystem::exists(stamp_path.parent_path() / line, ec)) return false;
+    }
+    return true;
+}
+
+void append_depfile_path(std::string& depfile, const std::filesystem::path& path)
+{
+    for(const char c : path.generic_string()) {
+        if(c == ' ' or c == '#') depfile.append(1, '\\');
+        else if(c == '$') depfile.append(1, '$');
+        depfile.append(1, c);
+    }
+}
+
+/* Format:
+kerning-pairs:<number of pairs>
+and then, sorted by left and then right code point:
+<left code point>:<right code point>:<horizontal offset in pixels>
+*/
+bool write_kerning_file(const std::string& output_stem, const std::vector<Kerning_pair>& pairs)
+{
+    std::string table {"kerning-pairs:"};
+    table.append(std::to_string(pairs.size())).append(1, '\n');
+    for(const Kerning_pair& pair : pairs) {
+        table.append(std::to_string(static_cast<uint32>(pair.left)));
+        table.append(1, ':').append(std::to_string(static_cast<uint32>(pair.right)));
+        table.append(1, ':').append(std::to_string(pair.x)).append(1, '\n');
+    }
+    std::ofstream kerning_file {create_output_filename(output_stem, "-kerning.txt"), std::ios_base::binary};
+    kerning_file.write(table.data(), table.size());
+    if(not kerning_file.good()) {
+        std::cout << "Internal error: Couldn't write the kerning file.\n";
+        return false;
+    }
+    return true;
+}
+
+// 'value' with two decimals
+std::string fixed_point(const double value)
+{
+    const int64 hundredths = static_cast<int64>(value * 100.0 + 0.5);
+    std::string str {std::to_string(hundredths / 100)};
+    str.append(1, '.').append(1, static_cast<char>('0' + hundredths / 10 % 10)).append(1, static_cast<char>('0' + hundredths % 10));
+    return str;
+}
+
+/* Packer statistics format:
+pages:<number of atlases>
+and then, for each atlas:
+page:<atlas>:<glyphs>:<used area>:<wasted area>:<occupancy in percent>
+followed by:
+searches:<free rectangle searches, one per placement attempt>
+average-free-rectangles:<free rectangles looked at per search>
+peak-free-rectangles:<most free rectangles at once>
+splits:<free rectangles split by a placed glyph>
+containment-tests:<tests of a free rectangle inside another one>
+search-ms:<time spent searching the best free rectangle>
+split-ms:<time spent splitting the free rectangles>
+prune-ms:<time spent dropping the redundant free rectangles>
+*/
+bool write_packer_stats(const std::string& output_stem, const Bin_stats& stats, const int image_size)
+{
+    const int64 page_area = static_cast<int64>(image_size) * image_size;
+    auto milliseconds = [](const std::chrono::steady_clock::duration d) { return fixed_point(std::chrono::duration<double, std::milli> {d}.count()); };
+    std::string report {"pages:"};
+    report.append(std::to_string(stats.pages.size())).append(1, '\n');
+    for(std::size_t i = 0; i < stats.pages.size(); ++i) {
+        const Bin_stats::Page& page = stats.pages[i];
+        report.append("page:").append(std::to_string(i));
+        report.append(1, ':').append(std::to_string(page.rectangles));
+        report.append(1, ':').append(std::to_string(page.used_area));
+        report.append(1, ':').append(std::to_string(page_area - page.used_area));
+        report.append(1, ':').append(fixed_point(100.0 * page.used_area / page_area)).append(1, '\n');
+    }
+    report.append("searches:").append(std::to_string(stats.searches)).append(1, '\n');
+    const double average = stats.searches ? static_cast<double>(stats.searched_free_rectangles) / stats.searches : 0.0;
+    report.append("average-free-rectangles:").append(fixed_point(average)).append(1, '\n');
+    report.append("peak-free-rectangles:").append(std::to_string(stats.peak_free_rectangles)).append(1, '\n');
+    report.append("splits:").append(std::to_string(stats.splits)).append(1, '\n');
+    report.append("containment-tests:").append(std::to_string(stats.containment_tests)).append(1, '\n');
+    report.append("search-ms:").append(milliseconds(stats.search_time)).append(1, '\n');
+    report.append("split-ms:").append(milliseconds(stats.split_time)).append(1, '\n');
+    report.append("prune-ms:").append(milliseconds(stats.prune_time)).append(1, '\n');
+    std::cout << report;
+
+    std::ofstream stats_file {create_output_filename(output_stem, "-packer-stats.txt"), std::ios_base::binary};
+    stats_file.write(report.data(), report.size());
+    if(not stats_file.good()) {
+        std::cout << "Internal error: Couldn't write the packer statistics file.\n";
+        return false;
+    }
+    return true;
+}
+
+bool write_stamp_and_depfile(const std::string& output_stem, const std::string& hash, const int bin_count, const bool kerning, const std::vector<std::filesystem::path>& font_file_paths, const std::filesystem::path& char_file_path)
+{
+    const std::filesystem::path info_path {create_output_filename(output_stem, 0, false)};
+    std::string stamp {hash};
+    stamp.append(1, '\n').append(info_path.filename().string());
+    stamp.append(1, '\n').append(output_stem).append("-notdef.png");
+    for(int i = 0; i < bin_count; ++i) {
+        stamp.append(1, '\n').append(create_output_filename(output_stem, i, true).filename().string());
+    }
+    if(kerning) stamp.append(1, '\n').append(output_stem).append("-kerning.txt");
+    stamp.append(1, '\n');
+
+    // Make/Ninja style: the information file depends on the font files and the characters file
+    std::string depfile;
+    append_depfile_path(depfile, info_path);
+    depfile.append(1, ':');
+    for(const std::filesystem::path& font_file_path : font_file_paths) {
+        depfile.append(1, ' ');
+        append_depfile_path(depfile, font_file_path);
+    }
+    if(not char_file_path.empty()) {
+        depfile.append(1, ' ');
+        append_depfile_path(depfile, char_file_path);
+    }
+    depfile.append(1, '\n');
+
+    std::ofstream depfile_file {create_output_filename(output_stem, ".d"), std::ios_base::binary};
+    depfile_file << depfile;
+    std::ofstream stamp_file {create_output_filename(output_stem, ".hash"), std::ios_base::binary};
+    stamp_file << stamp;
+    if(not depfile_file.good() or not stamp_file.good()) {
+        std::cout << "Internal error: Couldn't write the depfile or the input hash file.\n";
+        return false;
+    }
+    return true;
+}
+
+/* the glyph indices of a -glyph-ids file: decimal indices and inclusive ranges of them (10-20),
+* separated by commas or white space; returns them sorted and without duplicates, or false and the
+* offending item if one is malformed or not below 'glyph_count'
+*/
+bool parse_glyph_ids(std::string_view text, const FT_Long glyph_count, std::vector<FT_UInt>& glyph_ids, std::string& invalid_item)
+{
+    auto is_separator = [](const char c) { return c == ',' or c == ' ' or c == '\t' or c == '\r' or c == '\n'; };
+    auto parse_index = [&](std::string_view& str, FT_Long& index) {
+        std::size_t digits = 0;
+        index = 0;
+        for(; digits < str.size() and str[digits] >= '0' and str[digits] <= '9' and index < glyph_count; ++digits) index = index * 10 + (str[digits] - '0');
+        str.remove_prefix(digits);
+        return digits != 0 and index < glyph_count;
+    };
+    while(true) {
+        while(not text.empty() and is_separator(text.front())) text.remove_prefix(1);
+        if(text.empty()) break;
+        std::size_t item_size = 0;
+        while(item_size < text.size() and not is_separator(text[item_size])) ++item_size;
+        const std::string_view item = text.substr(0, item_size);
+        text.remove_prefix(item_size);
+
+        std::string_view str = item;
+        FT_Long first = 0;
+        bool valid = parse_index(str, first);
+        FT_Long last = first;
+        if(valid and str.starts_with('-')) {
+            str.remove_prefix(1);
+            valid = parse_index(str, last);
+        }
+        if(not valid or not str.empty() or first > last) {
+            invalid_item = item;
+            return false;
+        }
+        for(FT_Long index = first; index <= last; ++index) glyph_ids.push_back(static_cast<FT_UInt>(index));
+    }
+    std::sort(glyph_ids.begin(), glyph_ids.end());
+    glyph_ids.erase(std::unique(glyph_ids.begin(), glyph_ids.end()), glyph_ids.end());
+    return true;
+}
+
+// the optional columns of the information lines, so single font outputs without -subpixel keep their format
+struct Info_columns {
+    bool face = false; // with a fallback chain
+    bool variant = false; // with -subpixel
+    bool rotation = false; // with -allow-rotation
+};
+
+void place_char_info(std::ofstream& info_file, const Rect& rect_info, const Char_info& char_info, const Info_columns columns)
 {
     std::string info {std::to_string(static_cast<uint32>(rect_info.code_point))};
     info.append(1, ':').append(std::to_string(rect_info.bin));
@@ -112,38 +476,529 @@ void place_char_info(std::ofstream& info_file, const Rect& rect_info, const Char
     info.append(1, ':').append(std::to_string(char_info.top_bearing));
     info.append(1, ':').append(std::to_string(char_info.advance_x));
     info.append(1, ':').append(std::to_string(char_info.advance_y));
+    if(columns.face) info.append(1, ':').append(std::to_string(char_info.face));
+    if(columns.variant) info.append(1, ':').append(std::to_string(rect_info.variant));
+    if(columns.rotation) info.append(1, ':').append(rect_info.rotated ? "1" : "0");
     info.append(1, '\n');
     info_file << info;
 }
 
-void place_pixel_data(std::vector<uint8>& atlas, const int atlas_width, const Rect& where, const uint8* glyph_image, const int glyph_pitch)
+struct Glyph_bitmap {
+    const uint8* buffer = nullptr;
+    int width = 0;
+    int rows = 0;
+    int pitch = 0;
+    int left = 0; // left bearing
+    int top = 0; // top bearing
+    int channels = 1; // 3 for MSDF and LCD glyphs, 'width' is always in pixels
+    int spread = 8; // only used by MSDF shapes
+};
+
+// a copy of the bitmap of a rect's owner, to tell hash collisions apart (-dedup-bitmaps)
+struct Owned_bitmap {
+    char32_t owner = 0;
+    int width = 0;
+    int rows = 0;
+    int channels = 1;
+    std::vector<uint8> pixels; // rows of width * channels bytes, without padding
+};
+
+// characters whose glyph is already in the atlas share its rect and only get their own information line
+struct Glyph_sharing {
+    std::map<std::pair<int, FT_UInt>, char32_t> owners; // face and glyph index -> character that owns the rect
+    std::unordered_multimap<uint64, Owned_bitmap> bitmap_owners; // bitmap hash -> bitmaps that own a rect
+    std::multimap<char32_t, char32_t> aliases; // owner -> characters that share its rect
+};
+
+// does 'code_point' map to a glyph that is already packed? if so, it becomes an alias of that glyph
+bool share_glyph_by_index(Glyph_sharing& sharing, const int face, const FT_UInt glyph_index, const char32_t code_point, std::map<char32_t, Char_info>& characters)
+{
+    auto it = sharing.owners.find({face, glyph_index});
+    if(it == sharing.owners.end()) return false;
+    Char_info ci = characters[it->second];
+    ci.code_point = code_point;
+    characters.emplace(code_point, ci);
+    sharing.aliases.emplace(it->second, code_point);
+    return true;
+}
+
+/* is the just rendered bitmap identical to the bitmap of a packed glyph? the 64-bit hash finds the
+* candidates, their dimensions and pixels are then compared so that a collision can't merge two glyphs
+*/
+bool share_glyph_by_bitmap(Glyph_sharing& sharing, const int face, const FT_UInt glyph_index, const char32_t code_point, const Glyph_bitmap& bitmap)
+{
+    const std::size_t row_size = static_cast<std::size_t>(bitmap.width) * bitmap.channels;
+    const int32 dimensions[] {bitmap.width, bitmap.rows, bitmap.channels};
+    uint64 hash = hash_bytes(0xCBF29CE484222325ull, dimensions, sizeof(dimensions));
+    for(int row = 0; row < bitmap.rows; ++row) hash = hash_bytes(hash, bitmap.buffer + row * bitmap.pitch, row_size);
+
+    auto [first, last] = sharing.bitmap_owners.equal_range(hash);
+    for(auto it = first; it != last; ++it) {
+        const Owned_bitmap& owned = it->second;
+        if(owned.width != bitmap.width or owned.rows != bitmap.rows or owned.channels != bitmap.channels) continue;
+        int row = 0;
+        while(row < bitmap.rows and std::memcmp(owned.pixels.data() + row * row_size, bitmap.buffer + row * bitmap.pitch, row_size) == 0) ++row;
+        if(row < bitmap.rows) continue;
+        sharing.owners.emplace(std::pair {face, glyph_index}, owned.owner);
+        sharing.aliases.emplace(owned.owner, code_point);
+        return true;
+    }
+
+    Owned_bitmap owned {code_point, bitmap.width, bitmap.rows, bitmap.channels, {}};
+    owned.pixels.resize(row_size * bitmap.rows);
+    for(int row = 0; row < bitmap.rows; ++row) std::memcpy(owned.pixels.data() + row * row_size, bitmap.buffer + row * bitmap.pitch, row_size);
+    sharing.bitmap_owners.emplace(hash, std::move(owned));
+    return false;
+}
+
+/* renders the glyph loaded in 'slot', with the native SDF generator if one is given;
+* with an MSDF shape only the shape is loaded, the pixels are generated later
+*/
+FT_Error render_glyph(FT_GlyphSlot slot, const FT_Render_Mode render_mode, Sdf_generator* native_sdf, Msdf_shape* msdf_shape, Glyph_bitmap& bitmap)
 {
-    uint8* atlas_ptr = atlas.data();
-    atlas_ptr += atlas_width * where.y + where.x;
+    if(msdf_shape) {
+        if(slot->format != FT_GLYPH_FORMAT_OUTLINE) return FT_Err_Invalid_Glyph_Format;
+        if(not msdf_shape->load(slot->outline, bitmap.spread)) return FT_Err_Invalid_Outline;
+        bitmap.buffer = nullptr;
+        bitmap.width = msdf_shape->width();
+        bitmap.rows = msdf_shape->rows();
+        bitmap.pitch = msdf_shape->width() * 3;
+        bitmap.channels = 3;
+        bitmap.left = msdf_shape->left();
+        bitmap.top = msdf_shape->top();
+        return FT_Err_Ok;
+    }
+    if(native_sdf and native_sdf->render(slot)) {
+        bitmap.buffer = native_sdf->pixels();
+        bitmap.width = native_sdf->width();
+        bitmap.rows = native_sdf->rows();
+        bitmap.pitch = native_sdf->width();
+        bitmap.left = native_sdf->left();
+        bitmap.top = native_sdf->top();
+        return FT_Err_Ok;
+    }
+    // FreeType's SDF renderers also handle what the native generator can't (embedded bitmaps)
+    const FT_Error error = FT_Render_Glyph(slot, render_mode);
+    if(error) return error;
+    bitmap.buffer = slot->bitmap.buffer;
+    // LCD bitmaps hold 3 bytes (R, G and B) per pixel
+    bitmap.channels = slot->bitmap.pixel_mode == FT_PIXEL_MODE_LCD ? 3 : 1;
+    bitmap.width = slot->bitmap.width / bitmap.channels;
+    bitmap.rows = slot->bitmap.rows;
+    bitmap.pitch = slot->bitmap.pitch;
+    bitmap.left = slot->bitmap_left;
+    bitmap.top = slot->bitmap_top;
+    return FT_Err_Ok;
+}
+
+/* copies the rows of 'bitmap' into the rect 'where' of an atlas with the same number of channels;
+* only the pixels of the rect are copied, the padding at the end of FreeType's rows (the pitch) is skipped
+* and a negative pitch (rows stored bottom-up) is honoured
+*/
+void place_pixel_data(uint8* atlas, const int atlas_width, const Rect& where, const Glyph_bitmap& bitmap)
+{
+    const std::size_t row_size = static_cast<std::size_t>(where.w) * bitmap.channels;
+    uint8* atlas_ptr = atlas + (static_cast<std::size_t>(atlas_width) * where.y + where.x) * bitmap.channels;
+    const uint8* glyph_image = bitmap.buffer;
+    if(bitmap.pitch < 0) glyph_image -= static_cast<std::ptrdiff_t>(bitmap.pitch) * (bitmap.rows - 1);
     for(int row = 0; row < where.h; ++row) { // for each glyph's pixel row
-        std::memcpy(atlas_ptr, glyph_image, glyph_pitch);
-        atlas_ptr += atlas_width;
-        glyph_image += glyph_pitch;
+        std::memcpy(atlas_ptr, glyph_image, row_size);
+        atlas_ptr += static_cast<std::size_t>(atlas_width) * bitmap.channels;
+        glyph_image += bitmap.pitch;
+    }
+}
+
+/* like place_pixel_data for a rect that the packer turned (-allow-rotation): the glyph is copied
+* turned 90 degrees clockwise, its first row becomes the last column of the rect
+*/
+void place_rotated_pixel_data(uint8* atlas, const int atlas_width, const Rect& where, const Glyph_bitmap& bitmap)
+{
+    const int channels = bitmap.channels;
+    const std::size_t atlas_row_size = static_cast<std::size_t>(atlas_width) * channels;
+    const uint8* glyph_image = bitmap.buffer;
+    if(bitmap.pitch < 0) glyph_image -= static_cast<std::ptrdiff_t>(bitmap.pitch) * (bitmap.rows - 1);
+    for(int row = 0; row < bitmap.rows; ++row) { // for each glyph's pixel row, from the right column of the rect to the left one
+        uint8* atlas_ptr = atlas + (static_cast<std::size_t>(atlas_width) * where.y + where.x + (where.w - 1 - row)) * channels;
+        for(int x = 0; x < bitmap.width; ++x) {
+            std::memcpy(atlas_ptr, glyph_image + x * channels, channels);
+            atlas_ptr += atlas_row_size;
+        }
+        glyph_image += bitmap.pitch;
     }
 }
 
-bool create_png_image(const int image_width, const int image_height, const uint8* pixel_data, std::vector<uint8>& output)
+/* renders the outline loaded in 'slot' straight into the rect 'where' of a greyscale atlas, which
+* gives the pixels FT_Render_Glyph would give without its intermediate bitmap and the copy; the
+* outline is moved so that the bearings 'left' and 'top' of the glyph land on the corner of the rect
+* and the raster is clipped to the rect, the neighbour glyphs can't be touched
+*/
+FT_Error render_in_place(FT_Library library, FT_GlyphSlot slot, uint8* atlas, const int atlas_width, const Rect& where,
+                         const int left, const int top)
+{
+    if(where.w == 0 or where.h == 0) return FT_Err_Ok;
+    FT_Bitmap target {};
+    target.buffer = atlas + static_cast<std::size_t>(atlas_width) * where.y + where.x;
+    target.width = where.w;
+    target.rows = where.h;
+    target.pitch = atlas_width;
+    target.num_grays = 256;
+    target.pixel_mode = FT_PIXEL_MODE_GRAY;
+    FT_Outline_Translate(&slot->outline, -left * 64, (where.h - top) * 64);
+    return FT_Outline_Get_Bitmap(library, &slot->outline, &target);
+}
+
+/* can the glyph loaded in 'slot' be rendered in place? only plain greyscale outlines can, SDF and
+* LCD glyphs need the whole bitmap (and the LCD filter its margins) and outlines with overlapping
+* contours are oversampled by FreeType's renderer
+*/
+bool can_render_in_place(FT_GlyphSlot slot, const FT_Render_Mode render_mode, const Sdf_generator* native_sdf, const Msdf_shape* msdf_shape) noexcept
+{
+    return render_mode == FT_RENDER_MODE_NORMAL and not native_sdf and not msdf_shape and slot->format == FT_GLYPH_FORMAT_OUTLINE and
+           not (slot->outline.flags & FT_OUTLINE_OVERLAP);
+}
+
+// moves the outline loaded in 'slot' right by 'variant' / 'subpixel' of a pixel
+void shift_outline(FT_GlyphSlot slot, const int variant, const int subpixel) noexcept
+{
+    if(variant != 0 and slot->format == FT_GLYPH_FORMAT_OUTLINE) FT_Outline_Translate(&slot->outline, variant * 64 / subpixel, 0);
+}
+
+/* with -subpixel, renders the glyph again at each fractional offset; every variant gets its own
+* rect and bearings, the advances are the ones of the base glyph
+*/
+FT_Error add_subpixel_variants(FT_Face face, const FT_UInt glyph_index, const FT_Int32 load_flag, const int subpixel, const Char_info& base,
+                               const FT_Render_Mode render_mode, Sdf_generator* native_sdf, Msdf_shape* msdf_shape, Glyph_bitmap& bitmap,
+                               std::map<std::pair<char32_t, int>, Char_info>& variant_characters, std::vector<Rect>& glyph_rects)
+{
+    for(int variant = 1; variant < subpixel; ++variant) {
+        FT_Error error = FT_Load_Glyph(face, glyph_index, load_flag);
+        if(error) return error;
+        shift_outline(face->glyph, variant, subpixel);
+        error = render_glyph(face->glyph, render_mode, native_sdf, msdf_shape, bitmap);
+        if(error) return error;
+
+        Char_info ci = base;
+        ci.glyph_width = bitmap.width;
+        ci.glyph_height = bitmap.rows;
+        ci.left_bearing = bitmap.left;
+        ci.top_bearing = bitmap.top;
+        variant_characters.emplace(std::pair {base.code_point, variant}, ci);
+
+        Rect r;
+        r.code_point = base.code_point;
+        r.w = ci.glyph_width;
+        r.h = ci.glyph_height;
+        r.variant = variant;
+        glyph_rects.push_back(r);
+    }
+    return FT_Err_Ok;
+}
+
+/* the glyphs of a page are spread across threads, each one writes to its own part of the atlas;
+* turned glyphs are generated upright and then copied turned
+*/
+void generate_msdf_glyphs(uint8* atlas, const int atlas_width, const std::vector<std::pair<Rect, Msdf_shape>>& glyphs)
+{
+    std::atomic<std::size_t> next_glyph {0};
+    auto work = [&] {
+        std::vector<uint8> upright;
+        Msdf_scratch scratch;
+        for(std::size_t i = next_glyph++; i < glyphs.size(); i = next_glyph++) {
+            const Rect& r = glyphs[i].first;
+            if(not r.rotated) {
+                uint8* destination = atlas + (static_cast<std::size_t>(r.y) * atlas_width + r.x) * 3;
+                glyphs[i].second.generate(destination, atlas_width * 3, scratch);
+                count_processed_glyph();
+                continue;
+            }
+            Glyph_bitmap bitmap;
+            bitmap.width = r.h;
+            bitmap.rows = r.w;
+            bitmap.pitch = r.h * 3;
+            bitmap.channels = 3;
+            upright.resize(static_cast<std::size_t>(bitmap.pitch) * bitmap.rows);
+            glyphs[i].second.generate(upright.data(), bitmap.pitch, scratch);
+            bitmap.buffer = upright.data();
+            place_rotated_pixel_data(atlas, atlas_width, r, bitmap);
+            count_processed_glyph();
+        }
+    };
+    const unsigned thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), glyphs.size());
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < thread_count; ++i) threads.emplace_back(work);
+    work();
+    for(std::thread& t : threads) t.join();
+}
+
+// 'pixel_data' must hold image_size * image_size * channels bytes
+bool load_png_image(const std::filesystem::path& path, const int image_size, const int channels, uint8* pixel_data)
+{
+    png_image png_descriptor;
+    std::memset(&png_descriptor, 0, sizeof(png_image));
+    png_descriptor.version = PNG_IMAGE_VERSION;
+
+    std::ifstream png_image_file {path, std::ios_base::binary | std::ios_base::ate};
+    if(not png_image_file) {
+        std::cout << "Error: Couldn't open the atlas " << path.filename().string() << " of the previous run.\n";
+        return false;
+    }
+    std::vector<uint8> file_contents; file_contents.resize(png_image_file.tellg());
+    png_image_file.seekg(0, std::ios_base::beg);
+    png_image_file.read(reinterpret_cast<char*>(file_contents.data()), file_contents.size());
+    if(png_image_file.fail()) {
+        std::cout << "Error: Failed to read the atlas " << path.filename().string() << " of the previous run.\n";
+        return false;
+    }
+
+    if(not png_image_begin_read_from_memory(&png_descriptor, file_contents.data(), file_contents.size())) {
+        std::cout << "Error: The atlas " << path.filename().string() << " of the previous run is not a valid PNG image.\n";
+        png_image_free(&png_descriptor);
+        return false;
+    }
+    if(png_descriptor.width != static_cast<png_uint_32>(image_size) or png_descriptor.height != static_cast<png_uint_32>(image_size)) {
+        std::cout << "Error: The atlas " << path.filename().string() << " of the previous run doesn't match -image-size.\n";
+        png_image_free(&png_descriptor);
+        return false;
+    }
+    png_descriptor.format = channels == 3 ? PNG_FORMAT_RGB : PNG_FORMAT_GRAY;
+    if(not png_image_finish_read(&png_descriptor, NULL, pixel_data, 0, NULL)) {
+        std::cout << "Internal error: png_image_finish_read failed.\n";
+        png_image_free(&png_descriptor);
+        return false;
+    }
+    return true;
+}
+
+struct Previous_run {
+    std::string notdef_line;
+    std::vector<Rect> glyph_rects;
+    int linespace = 0;
+    int bin_count = 0;
+};
+
+template<typename Score_policy, bool Multiple_bins>
+Bin_stats layout_in_bins(const Cli_args& cli_args, std::vector<Rect>& glyph_rects, int& processed_rectangles)
+{
+    Basic_bin<Score_policy, Multiple_bins> bin {cli_args.image_size, cli_args.image_size, cli_args.allow_rotation};
+    if(cli_args.packer_stats) bin.enable_timing();
+    bin.layout_bulk(glyph_rects);
+    processed_rectangles = bin.processed_rectangles();
+    return bin.stats();
+}
+
+/* places the sorted 'glyph_rects' in the atlases, 'placed_rects' receives those that fit;
+* with -update, first fills the free space left in the atlases of the previous run
+*/
+template<typename Score_policy>
+bool pack_glyphs(const Cli_args& cli_args, const Previous_run& previous, std::vector<Rect>& glyph_rects, std::vector<Rect>& placed_rects, Bin_stats& packer_stats)
+{
+    for(int bin_instance = 0; bin_instance < previous.bin_count; ++bin_instance) {
+        Basic_bin<Score_policy, false> bin {cli_args.image_size, cli_args.image_size, cli_args.allow_rotation};
+        if(cli_args.packer_stats) bin.enable_timing();
+        // aliases and shared bitmaps have a line each but a single rectangle, it is occupied once
+        std::set<std::tuple<int, int, int, int>> occupied;
+        for(const Rect& r : previous.glyph_rects) {
+            if(r.bin == bin_instance and occupied.emplace(r.x, r.y, r.w, r.h).second) bin.occupy(r);
+        }
+        std::erase_if(glyph_rects, [&](Rect& r) {
+            if(not bin.insert(r)) return false;
+            r.bin = bin_instance;
+            placed_rects.push_back(r);
+            return true;
+        });
+        count_packed_pages(1);
+        packer_stats += bin.stats();
+    }
+    if(not cli_args.multiple_images and previous.bin_count > 0) return true;
+    int processed_rectangles = static_cast<int>(glyph_rects.size());
+    Bin_stats stats;
+    try {
+        if(cli_args.parallel_pack) stats = layout_parallel<Score_policy>(glyph_rects, cli_args.image_size, cli_args.image_size, cli_args.allow_rotation, cli_args.packer_stats);
+        else if(cli_args.multiple_images) stats = layout_in_bins<Score_policy, true>(cli_args, glyph_rects, processed_rectangles);
+        else stats = layout_in_bins<Score_policy, false>(cli_args, glyph_rects, processed_rectangles);
+    }
+    catch(const std::runtime_error& e) {
+        std::cout << e.what() << '\n';
+        return false;
+    }
+    // the packer doesn't know about -progress (maxrects stays self-contained), its pages are counted here
+    count_packed_pages(stats.pages.size());
+    packer_stats += stats;
+    for(int i = 0; i < processed_rectangles; ++i) {
+        glyph_rects[i].bin += previous.bin_count;
+        placed_rects.push_back(glyph_rects[i]);
+    }
+    return true;
+}
+
+// -heuristic, each entry is the packing compiled for one scoring policy
+struct Heuristic {
+    const char* name;
+    bool (*pack)(const Cli_args&, const Previous_run&, std::vector<Rect>&, std::vector<Rect>&, Bin_stats&);
+};
+
+constexpr Heuristic heuristics[] {
+    {"area", pack_glyphs<Best_area_fit>},
+    {"short-side", pack_glyphs<Best_short_side_fit>},
+    {"long-side", pack_glyphs<Best_long_side_fit>},
+    {"top-left", pack_glyphs<Top_left>},
+};
+
+// reads the information file written by a previous run so that its glyphs can keep their places
+bool read_previous_info(const std::filesystem::path& path, const int image_size, const int face_count, const int subpixel, const bool allow_rotation,
+                        std::map<char32_t, Char_info>& characters, std::map<std::pair<char32_t, int>, Char_info>& variant_characters, Previous_run& previous)
+{
+    std::ifstream info_file {path, std::ios_base::binary};
+    if(not info_file) {
+        std::cout << "Error: -update was specified but the information file of the previous run couldn't be opened.\n";
+        return false;
+    }
+
+    std::string line;
+    int32 line_number = 1; // just for a better error message
+    std::vector<long long> fields;
+    while(std::getline(info_file, line)) {
+        if(line.empty()) continue;
+
+        if(line.starts_with("atlas-dimensions:")) {
+            if(std::atoi(line.c_str() + 17) != image_size) {
+                std::cout << "Error: -image-size doesn't match the atlas dimensions of the previous run.\n";
+                return false;
+            }
+        }
+        else if(line.starts_with("linespace:")) {
+            previous.linespace = std::atoi(line.c_str() + 10);
+        }
+        else if(line.starts_with("notdef:")) {
+            previous.notdef_line = line;
+        }
+        else {
+            fields.clear();
+            const char* str = line.c_str();
+            char* end = nullptr;
+            while(true) {
+                fields.push_back(std::strtoll(str, &end, 10));
+                if(end == str) break;
+                if(*end != ':') break;
+                str = end + 1;
+            }
+            const std::size_t field_count = 10 + (face_count > 1 ? 1 : 0) + (subpixel > 1 ? 1 : 0) + (allow_rotation ? 1 : 0);
+            if(fields.size() != field_count or *end != '\0') {
+                std::cout << "Error: The information file of the previous run is malformed at line #" << line_number << ".\n";
+                return false;
+            }
+
+            Rect r;
+            r.code_point = static_cast<char32_t>(fields[0]);
+            r.bin = static_cast<int>(fields[1]);
+            r.x = static_cast<int>(fields[2]);
+            r.y = static_cast<int>(fields[3]);
+            r.w = static_cast<int>(fields[4]);
+            r.h = static_cast<int>(fields[5]);
+            if(r.bin < 0 or r.x < 0 or r.y < 0 or r.x + r.w > image_size or r.y + r.h > image_size) {
+                std::cout << "Error: The information file of the previous run is malformed at line #" << line_number << ".\n";
+                return false;
+            }
+
+            std::size_t column = 10; // the optional columns, in the order place_char_info writes them
+            Char_info ci;
+            ci.code_point = r.code_point;
+            ci.left_bearing = static_cast<int>(fields[6]);
+            ci.top_bearing = static_cast<int>(fields[7]);
+            ci.advance_x = static_cast<int>(fields[8]);
+            ci.advance_y = static_cast<int>(fields[9]);
+            if(face_count > 1) ci.face = static_cast<int>(fields[column++]);
+            if(subpixel > 1) r.variant = static_cast<int>(fields[column++]);
+            if(allow_rotation) r.rotated = fields[column++] != 0;
+            ci.glyph_width = r.rotated ? r.h : r.w;
+            ci.glyph_height = r.rotated ? r.w : r.h;
+            if(ci.face < 0 or ci.face >= face_count or r.variant < 0 or r.variant >= subpixel) {
+                std::cout << "Error: The information file of the previous run is malformed at line #" << line_number << ".\n";
+                return false;
+            }
+
+            if(r.variant == 0) characters.emplace(r.code_point, ci);
+            else variant_characters.emplace(std::pair {r.code_point, r.variant}, ci);
+            previous.glyph_rects.push_back(r);
+            previous.bin_count = std::max(previous.bin_count, r.bin + 1);
+        }
+
+        ++line_number;
+    }
+    if(not info_file.eof()) {
+        std::cout << "Internal error: An error ocurred while reading the information file of the previous run.\n";
+        return false;
+    }
+    if(previous.notdef_line.empty()) {
+        std::cout << "Error: The information file of the previous run is malformed.\n";
+        return false;
+    }
+    return true;
+}
+
+// writes the line of the character that owns 'rect_info' and the lines of the characters that share it
+void place_shared_char_info(std::ofstream& info_file, const Rect& rect_info, std::map<char32_t, Char_info>& characters,
+                            std::map<std::pair<char32_t, int>, Char_info>& variant_characters, const Glyph_sharing& sharing, const Info_columns columns)
+{
+    const Char_info& owner_info = characters[rect_info.code_point];
+    const Char_info& info = rect_info.variant == 0 ? owner_info : variant_characters[{rect_info.code_point, rect_info.variant}];
+    place_char_info(info_file, rect_info, info, columns);
+    const auto [first, last] = sharing.aliases.equal_range(rect_info.code_point);
+    for(auto it = first; it != last; ++it) {
+        Rect alias_rect = rect_info;
+        alias_rect.code_point = it->second;
+        // a subpixel variant moves the bearings of the characters that share it like the ones of its owner
+        Char_info alias_info = characters[it->second];
+        alias_info.left_bearing += info.left_bearing - owner_info.left_bearing;
+        alias_info.top_bearing += info.top_bearing - owner_info.top_bearing;
+        place_char_info(info_file, alias_rect, alias_info, columns);
+    }
+}
+
+/* with -glyph-ids, the lines are written once the atlases are done, in glyph index order and with a
+* line for every glyph of the font (and every -subpixel variant), so that the line of a glyph can be
+* found by its index; the glyphs that aren't in the atlases get a line of zeros with -1 as their image
+*/
+void place_glyph_info(std::ofstream& info_file, std::vector<Rect> rects, std::map<char32_t, Char_info>& characters,
+                      std::map<std::pair<char32_t, int>, Char_info>& variant_characters, const FT_Long glyph_count, const int subpixel, const Info_columns columns)
+{
+    std::sort(rects.begin(), rects.end(), [](const Rect& lhs, const Rect& rhs) {
+        return lhs.code_point != rhs.code_point ? lhs.code_point < rhs.code_point : lhs.variant < rhs.variant;
+    });
+    auto next = rects.cbegin();
+    for(FT_Long glyph = 0; glyph < glyph_count; ++glyph) {
+        for(int variant = 0; variant < subpixel; ++variant) {
+            if(next != rects.cend() and next->code_point == static_cast<char32_t>(glyph) and next->variant == variant) {
+                place_char_info(info_file, *next, variant == 0 ? characters[next->code_point] : variant_characters[{next->code_point, variant}], columns);
+                ++next;
+                continue;
+            }
+            Rect missing;
+            missing.code_point = static_cast<char32_t>(glyph);
+            missing.variant = variant;
+            place_char_info(info_file, missing, Char_info {}, columns);
+        }
+    }
+}
+
+// 'row_stride' is in bytes, like FreeType's pitch (negative for bottom-up rows)
+bool create_png_image(const int image_width, const int image_height, const int channels, const uint8* pixel_data, const int row_stride, std::vector<uint8>& output)
 {
     png_image png_descriptor;
     std::memset(&png_descriptor, 0, sizeof(png_image));
     png_descriptor.version = PNG_IMAGE_VERSION;
     png_descriptor.width = image_width;
     png_descriptor.height = image_height;
-    png_descriptor.format = PNG_FORMAT_GRAY;
+    png_descriptor.format = channels == 3 ? PNG_FORMAT_RGB : PNG_FORMAT_GRAY;
 
     png_alloc_size_t buffer_size;
-    if(not png_image_write_get_memory_size(png_descriptor, buffer_size, 0, pixel_data, 0, NULL)) {
+    if(not png_image_write_get_memory_size(png_descriptor, buffer_size, 0, pixel_data, row_stride, NULL)) {
         std::cout << "Internal error: png_image_write_get_memory_size failed.\n";
         png_image_free(&png_descriptor);
         return false;
     }
     std::vector<uint8> the_png_image; the_png_image.resize(buffer_size);
-    if(not png_image_write_to_memory(&png_descriptor, the_png_image.data(), &buffer_size, 0, pixel_data, 0, NULL)) {
+    if(not png_image_write_to_memory(&png_descriptor, the_png_image.data(), &buffer_size, 0, pixel_data, row_stride, NULL)) {
         std::cout << "Internal error: png_image_write_to_memory failed.\n";
         png_image_free(&png_descriptor);
         return false;
@@ -153,14 +1008,14 @@ bool create_png_image(const int image_width, const int image_height, const uint8
     return true;
 }
 
-bool create_png_image(const std::string& output_stem, const int current_bin_instance, const int image_size, const uint8* pixel_data)
+bool create_png_image(const std::string& output_stem, const int current_bin_instance, const int image_size, const int channels, const uint8* pixel_data)
 {
     png_image png_descriptor;
     std::memset(&png_descriptor, 0, sizeof(png_image));
     png_descriptor.version = PNG_IMAGE_VERSION;
     png_descriptor.width = image_size;
     png_descriptor.height = image_size;
-    png_descriptor.format = PNG_FORMAT_GRAY;
+    png_descriptor.format = channels == 3 ? PNG_FORMAT_RGB : PNG_FORMAT_GRAY;
 
     png_alloc_size_t buffer_size;
     if(not png_image_write_get_memory_size(png_descriptor, buffer_size, 0, pixel_data, 0, NULL)) {
@@ -187,29 +1042,76 @@ bool create_png_image(const std::string& output_stem, const int current_bin_inst
         return false;
     }
     png_image_free(&png_descriptor);
+    count_encoded_page();
+    count_written_bytes(the_png_image.size());
     return true;
 }
 
+/* the pixels of the atlas being generated; the memory comes from calloc, so the parts no glyph is
+* written to stay untouched zero pages that the operating system never commits (glibc, for one,
+* serves blocks this large straight from mmap); a new atlas is allocated again rather than cleared
+*/
+class Atlas_page {
+public:
+    Atlas_page() noexcept {};
+    ~Atlas_page() { release(); }
+    Atlas_page(const Atlas_page&) = delete;
+    Atlas_page& operator=(const Atlas_page&) = delete;
+
+    bool allocate(const std::size_t size) noexcept
+    {
+        release();
+        m_pixels = static_cast<uint8*>(std::calloc(size, 1));
+        return m_pixels != nullptr;
+    }
+    void release() noexcept
+    {
+        std::free(m_pixels);
+        m_pixels = nullptr;
+    }
+    uint8* data() noexcept { return m_pixels; }
+private:
+    uint8* m_pixels = nullptr;
+};
+
 App::~App()
 {
-    if(m_font_face) FT_Done_Face(m_font_face);
-    if(m_freetype_library) FT_Done_FreeType(m_freetype_library);
+    for(FT_Face face : m_font_faces) FT_Done_Face(face);
+    // not FT_Done_FreeType, it would also free the FT_Memory, which belongs to the pool
+    if(m_freetype_library) FT_Done_Library(m_freetype_library);
 }
 
 int App::run(int argc, char** argv)
 {
-    if(argc < 5) {
-        std::cout << "Error: Not enough arguments given.\nFor help with using this program, read Manual.html\n";
-        std::cout << "Number of arguments: " << argc << '\n';
-        return EXIT_FAILURE;
-    }
-
     const std::filesystem::path exe_dir {get_exe_dir()};
     if(exe_dir.empty()) {
         std::cout << "Internal error: Couldn't retrieve the program's executable path.\n";
         return EXIT_FAILURE;
     }
 
+    // -serve ignores every other argument, so it is handled first
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "-serve") != 0) continue;
+        const int j = i + 1;
+        if(valid_arg_index(j, argc - 1) and argv[j][0] != '-') return run_glyph_server(exe_dir, argv[j]);
+        return run_glyph_server(exe_dir, std::string {});
+    }
+    // so does -coverage, it takes the list of fonts and the list of characters files
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "-coverage") != 0) continue;
+        if(not valid_arg_index(i + 2, argc - 1) or argv[i + 1][0] == '-' or argv[i + 2][0] == '-') {
+            std::cout << "Error: -coverage needs a list of fonts and a list of characters files.\n";
+            return EXIT_FAILURE;
+        }
+        return run_coverage_report(exe_dir, argv[i + 1], argv[i + 2]);
+    }
+
+    if(argc < 5) {
+        std::cout << "Error: Not enough arguments given.\nFor help with using this program, read Manual.html\n";
+        std::cout << "Number of arguments: " << argc << '\n';
+        return EXIT_FAILURE;
+    }
+
     /* parse the given command line arguments */
 
     Cli_args cli_args;
@@ -240,6 +1142,16 @@ int App::run(int argc, char** argv)
                 cli_args.char_file = argv[j];
             }
         }
+        else if(std::strcmp(argv[i], "-glyph-ids") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                cli_args.glyph_ids = argv[j];
+            }
+        }
+        else if(std::strcmp(argv[i], "-ranges") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                cli_args.ranges = argv[j];
+            }
+        }
         else if(std::strcmp(argv[i], "-verify") == 0) {
             cli_args.verify = true;
         }
@@ -260,6 +1172,85 @@ int App::run(int argc, char** argv)
         else if(std::strcmp(argv[i], "-sdf") == 0) {
             cli_args.sdf = true;
         }
+        else if(std::strcmp(argv[i], "-update") == 0) {
+            cli_args.update = true;
+        }
+        else if(std::strcmp(argv[i], "-force") == 0) {
+            cli_args.force = true;
+        }
+        else if(std::strcmp(argv[i], "-sdf-engine") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                if(std::strcmp(argv[j], "native") == 0) cli_args.native_sdf = true;
+                else if(std::strcmp(argv[j], "freetype") != 0) {
+                    std::cout << "Error: -sdf-engine was given an invalid value.\n";
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else if(std::strcmp(argv[i], "-lcd") == 0) {
+            cli_args.lcd = true;
+        }
+        else if(std::strcmp(argv[i], "-lcd-filter") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                if(std::strcmp(argv[j], "default") == 0) cli_args.lcd_filter = FT_LCD_FILTER_DEFAULT;
+                else if(std::strcmp(argv[j], "light") == 0) cli_args.lcd_filter = FT_LCD_FILTER_LIGHT;
+                else if(std::strcmp(argv[j], "legacy") == 0) cli_args.lcd_filter = FT_LCD_FILTER_LEGACY;
+                else if(std::strcmp(argv[j], "none") == 0) cli_args.lcd_filter = FT_LCD_FILTER_NONE;
+                else {
+                    std::cout << "Error: -lcd-filter was given an invalid value.\n";
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        else if(std::strcmp(argv[i], "-heuristic") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                const auto found = std::find_if(std::cbegin(heuristics), std::cend(heuristics), [&](const Heuristic& h) { return std::strcmp(argv[j], h.name) == 0; });
+                if(found == std::cend(heuristics)) {
+                    std::cout << "Error: -heuristic was given an invalid value.\n";
+                    return EXIT_FAILURE;
+                }
+                cli_args.heuristic = static_cast<int>(found - std::cbegin(heuristics));
+            }
+        }
+        else if(std::strcmp(argv[i], "-msdf") == 0) {
+            cli_args.msdf = true;
+        }
+        else if(std::strcmp(argv[i], "-subpixel") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                cli_args.subpixel = std::atoi(argv[j]);
+            }
+        }
+        else if(std::strcmp(argv[i], "-max-memory") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                cli_args.max_memory = std::atoi(argv[j]);
+            }
+        }
+        else if(std::strcmp(argv[i], "-alloc-stats") == 0) {
+            cli_args.alloc_stats = true;
+        }
+        else if(std::strcmp(argv[i], "-progress") == 0) {
+            cli_args.progress = true;
+        }
+        else if(std::strcmp(argv[i], "-packer-stats") == 0) {
+            cli_args.packer_stats = true;
+        }
+        else if(std::strcmp(argv[i], "-parallel-pack") == 0) {
+            cli_args.parallel_pack = true;
+        }
+        else if(std::strcmp(argv[i], "-allow-rotation") == 0) {
+            cli_args.allow_rotation = true;
+        }
+        else if(std::strcmp(argv[i], "-kerning") == 0) {
+            cli_args.kerning = true;
+        }
+        else if(std::strcmp(argv[i], "-dedup-bitmaps") == 0) {
+            cli_args.dedup_bitmaps = true;
+        }
+        else if(std::strcmp(argv[i], "-sdf-spread") == 0) {
+            if(valid_arg_index(j, last_arg_index)) {
+                cli_args.sdf_spread = std::atoi(argv[j]);
+            }
+        }
         else {
             std::cout << "Error: Invalid argument given (" << argv[i] << ").\n";
             return EXIT_FAILURE;
@@ -272,6 +1263,11 @@ int App::run(int argc, char** argv)
         std::cout << "Error: -font wasn't given a value.\n";
         return EXIT_FAILURE;
     }
+    cli_args.font_files = split_font_list(cli_args.font_file);
+    if(std::ranges::any_of(cli_args.font_files, [](const std::string& f) { return f.empty(); })) {
+        std::cout << "Error: -font was given an empty font file name.\n";
+        return EXIT_FAILURE;
+    }
     if(cli_args.output_stem.empty() and not cli_args.verify) {
         std::cout << "Error: -output-stem wasn't given a value.\n";
         return EXIT_FAILURE;
@@ -280,76 +1276,234 @@ int App::run(int argc, char** argv)
         std::cout << "Error: -font-size was given an invalid value.\n";
         return EXIT_FAILURE;
     }
-    if(cli_args.image_size == 0 and not cli_args.verify) {
+    if(cli_args.image_size <= 0 and not cli_args.verify) {
         std::cout << "Error: -image-size was given an invalid value.\n";
         return EXIT_FAILURE;
     }
-    if(cli_args.verify and cli_args.char_file.empty()) {
-        std::cout << "Error: -verify was specified but -char-file wasn't given a value.\n";
+    if(cli_args.verify and cli_args.char_file.empty() and cli_args.ranges.empty()) {
+        std::cout << "Error: -verify was specified but neither -char-file nor -ranges were given a value.\n";
         return EXIT_FAILURE;
     }
-    if(cli_args.as_given and cli_args.char_file.empty()) {
-        std::cout << "Error: -as-given was specified but -char-file was not provided.\n";
+    if(cli_args.as_given and cli_args.char_file.empty() and cli_args.ranges.empty()) {
+        std::cout << "Error: -as-given was specified but neither -char-file nor -ranges were provided.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.sdf_spread < 2 or cli_args.sdf_spread > 32) { // the range FreeType accepts
+        std::cout << "Error: -sdf-spread was given an invalid value.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.subpixel < 1 or cli_args.subpixel > 16) {
+        std::cout << "Error: -subpixel was given an invalid value.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.max_memory < 0) {
+        std::cout << "Error: -max-memory was given an invalid value.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.msdf and cli_args.sdf) {
+        std::cout << "Error: -msdf can't be used along -sdf.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.dedup_bitmaps and cli_args.msdf) {
+        std::cout << "Error: -dedup-bitmaps can't be used along -msdf.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.lcd and (cli_args.sdf or cli_args.msdf)) {
+        std::cout << "Error: -lcd can't be used along -sdf or -msdf.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.native_sdf and not cli_args.sdf) {
+        std::cout << "Error: -sdf-engine was specified but -sdf was not provided.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.parallel_pack and not cli_args.multiple_images) {
+        std::cout << "Error: -parallel-pack was specified but -multiple-images was not provided.\n";
+        return EXIT_FAILURE;
+    }
+    if(cli_args.update and cli_args.verify) {
+        std::cout << "Error: -update can't be used along -verify.\n";
+        return EXIT_FAILURE;
+    }
+    const bool glyph_index_mode = not cli_args.glyph_ids.empty();
+    if(glyph_index_mode and (not cli_args.char_file.empty() or not cli_args.ranges.empty() or cli_args.verify)) {
+        std::cout << "Error: -glyph-ids can't be used along -char-file, -ranges or -verify.\n";
+        return EXIT_FAILURE;
+    }
+    if(glyph_index_mode and (cli_args.update or cli_args.dedup_bitmaps)) {
+        std::cout << "Error: -glyph-ids can't be used along -update or -dedup-bitmaps.\n";
+        return EXIT_FAILURE;
+    }
+    if(glyph_index_mode and cli_args.font_files.size() > 1) { // glyph indices only mean something within one font
+        std::cout << "Error: -glyph-ids needs a single font file.\n";
         return EXIT_FAILURE;
     }
 
     /* validation for -load-vert-metrics is pending, FreeType needs to be initialised first */
 
-    FT_Error error = FT_Init_FreeType(&m_freetype_library);
-    if(error) {
-        std::cout << "Internal error: FreeType initialisation failed.\n";
-        return EXIT_FAILURE;
+    Alloc_report alloc_report;
+    Progress_report progress;
+    auto begin_phase = [&](const char* name, const uint64 glyph_total) {
+        if(cli_args.alloc_stats) alloc_report.begin_phase(name);
+        if(cli_args.progress) progress.begin_phase(name, glyph_total);
+    };
+    if(cli_args.alloc_stats) enable_alloc_counting();
+    if(cli_args.progress) progress.start();
+    begin_phase("input-files", 0);
+
+    // load the font files into memory
+    std::vector<std::filesystem::path> font_file_paths;
+    std::vector<std::vector<uint8>> in_memory_font_files;
+    for(const std::string& font_file : cli_args.font_files) {
+        std::filesystem::path& font_file_path = font_file_paths.emplace_back(exe_dir);
+        font_file_path.append(font_file);
+
+        std::ifstream ifs {font_file_path, std::ios_base::binary | std::ios_base::ate};
+        if(not ifs) {
+            std::cout << "Error: Failed to open the font file " << font_file << ".\n";
+            return EXIT_FAILURE;
+        }
+        const std::streamoff font_file_size = ifs.tellg();
+        std::vector<uint8>& in_memory_font_file = in_memory_font_files.emplace_back();
+        in_memory_font_file.resize(font_file_size);
+        ifs.seekg(0, std::ios_base::beg);
+        ifs.read(reinterpret_cast<char*>(in_memory_font_file.data()), font_file_size);
+        if(ifs.fail() and not ifs.eof()) {
+            std::cout << "Error: Failed to read the font file " << font_file << ".\n";
+            return EXIT_FAILURE;
+        }
     }
-    // load the font file into memory
-    std::filesystem::path font_file_path {exe_dir};
-    font_file_path.append(cli_args.font_file);
 
-    std::ifstream ifs {font_file_path, std::ios_base::binary | std::ios_base::ate};
-    if(not ifs) {
-        std::cout << "Error: Failed to open the font file.\n";
-        return EXIT_FAILURE;
+    /* skip the whole generation if the inputs didn't change since the last successful run */
+
+    std::filesystem::path char_file_path;
+    Char_file char_file;
+    if(not cli_args.char_file.empty()) {
+        char_file_path = exe_dir;
+        char_file_path.append(cli_args.char_file);
+        if(not char_file.open(char_file_path)) {
+            std::cout << "Error: Couldn't open the characters file.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    // a -glyph-ids file is small, it is simply read
+    std::filesystem::path glyph_id_file_path;
+    std::string glyph_id_file;
+    if(glyph_index_mode and cli_args.glyph_ids != "all") {
+        glyph_id_file_path = exe_dir;
+        glyph_id_file_path.append(cli_args.glyph_ids);
+        std::ifstream ifs {glyph_id_file_path, std::ios_base::binary};
+        if(not ifs) {
+            std::cout << "Error: Couldn't open the glyph indices file.\n";
+            return EXIT_FAILURE;
+        }
+        glyph_id_file.assign(std::istreambuf_iterator<char> {ifs}, std::istreambuf_iterator<char> {});
+        if(ifs.bad()) {
+            std::cout << "Error: Failed to read the glyph indices file.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::string input_hash;
+    if(not cli_args.verify) {
+        input_hash = hash_to_string(hash_inputs(cli_args, in_memory_font_files, char_file.contents(), glyph_id_file));
+        const std::filesystem::path stamp_path {create_output_filename(cli_args.output_stem, ".hash")};
+        // the diagnostics (-alloc-stats, -packer-stats, -progress) are about a run, so they force one
+        const bool diagnostics = cli_args.alloc_stats or cli_args.packer_stats or cli_args.progress;
+        if(not cli_args.force and not diagnostics and outputs_up_to_date(stamp_path, input_hash)) {
+            std::cout << "The inputs didn't change, the generated files are up to date.\n";
+            return EXIT_SUCCESS;
+        }
+        // a run that fails midway must not leave a valid stamp behind
+        std::error_code ec;
+        std::filesystem::remove(stamp_path, ec);
     }
-    const std::streamoff font_file_size = ifs.tellg();
-    std::vector<uint8> in_memory_font_file;
-    in_memory_font_file.resize(font_file_size);
-    ifs.seekg(0, std::ios_base::beg);
-    ifs.read(reinterpret_cast<char*>(in_memory_font_file.data()), font_file_size);
-    if(ifs.fail() and not ifs.eof()) {
-        std::cout << "Error: Failed to read the font file.\n";
+    // only parsed once the generation can't be skipped
+    if(not char_file.parse()) {
+        std::cout << "Error: Invalid UTF-8 found in the characters file at line #" << char_file.invalid_line() << ".\n";
         return EXIT_FAILURE;
     }
-    ifs.close();
-    error = FT_New_Memory_Face(m_freetype_library, in_memory_font_file.data(), font_file_size, 0, &m_font_face);
-    if(error) {
-        std::cout << "Internal error: FT_New_Memory_Face failed.\n";
+    if(not cli_args.ranges.empty() and not char_file.add_ranges(cli_args.ranges)) {
+        std::cout << "Error: -ranges was given an invalid range or preset (" << char_file.invalid_range() << ").\n";
         return EXIT_FAILURE;
     }
-    error = FT_Select_Charmap(m_font_face, FT_ENCODING_UNICODE);
+    const bool whole_font = cli_args.char_file.empty() and cli_args.ranges.empty() and not glyph_index_mode;
+
+    begin_phase("freetype", 0);
+    // what FT_Init_FreeType does, but with the allocator of the pool
+    FT_Error error = FT_New_Library(m_freetype_memory_pool.memory(), &m_freetype_library);
+    if(not error) {
+        FT_Add_Default_Modules(m_freetype_library);
+        FT_Set_Default_Properties(m_freetype_library);
+    }
     if(error) {
-        std::cout << "Error: The font file doesn't contain a Unicode character map.\n";
+        std::cout << "Internal error: FreeType initialisation failed.\n";
         return EXIT_FAILURE;
     }
-    error = FT_Set_Pixel_Sizes(m_font_face, 0, cli_args.font_size);
+    // both the outline ("sdf") and the bitmap ("bsdf") SDF renderers take the spread
+    error = FT_Property_Set(m_freetype_library, "sdf", "spread", &cli_args.sdf_spread);
+    if(not error) error = FT_Property_Set(m_freetype_library, "bsdf", "spread", &cli_args.sdf_spread);
     if(error) {
-        std::cout << "Internal error: FT_Set_Pixel_Sizes failed.\n";
+        std::cout << "Internal error: Setting the spread of FreeType's SDF renderers failed.\n";
         return EXIT_FAILURE;
     }
-    // validate -load-vert-metrics
-    if(cli_args.load_vert_metrics and not FT_HAS_VERTICAL(m_font_face)) {
-        std::cout << "Error: The font file doesn't contain vertical metrics.\n";
+    // builds without ClearType-style filtering render LCD glyphs with their own method and no filter
+    error = FT_Library_SetLcdFilter(m_freetype_library, static_cast<FT_LcdFilter>(cli_args.lcd_filter));
+    if(cli_args.lcd and error and error != FT_Err_Unimplemented_Feature) {
+        std::cout << "Internal error: Setting the LCD filter failed.\n";
         return EXIT_FAILURE;
     }
+    for(std::size_t i = 0; i < in_memory_font_files.size(); ++i) {
+        const std::vector<uint8>& in_memory_font_file = in_memory_font_files[i];
+        FT_Face& face = m_font_faces.emplace_back(nullptr);
+        error = FT_New_Memory_Face(m_freetype_library, in_memory_font_file.data(), static_cast<FT_Long>(in_memory_font_file.size()), 0, &face);
+        if(error) {
+            m_font_faces.pop_back();
+            std::cout << "Internal error: FT_New_Memory_Face failed for the font file " << cli_args.font_files[i] << ".\n";
+            return EXIT_FAILURE;
+        }
+        error = FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+        if(error) {
+            std::cout << "Error: The font file " << cli_args.font_files[i] << " doesn't contain a Unicode character map.\n";
+            return EXIT_FAILURE;
+        }
+        error = FT_Set_Pixel_Sizes(face, 0, cli_args.font_size);
+        if(error) {
+            std::cout << "Internal error: FT_Set_Pixel_Sizes failed.\n";
+            return EXIT_FAILURE;
+        }
+        // validate -load-vert-metrics
+        if(cli_args.load_vert_metrics and not FT_HAS_VERTICAL(face)) {
+            std::cout << "Error: The font file " << cli_args.font_files[i] << " doesn't contain vertical metrics.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    // the first font gives the line spacing and the .notdef glyph
+    FT_Face main_face = m_font_faces.front();
+    const bool fallback_chain = m_font_faces.size() > 1;
+    const Info_columns info_columns {fallback_chain, cli_args.subpixel > 1, cli_args.allow_rotation};
+    std::vector<FT_UInt> glyph_ids;
+    if(cli_args.glyph_ids == "all") {
+        glyph_ids.resize(main_face->num_glyphs);
+        for(std::size_t i = 0; i < glyph_ids.size(); ++i) glyph_ids[i] = static_cast<FT_UInt>(i);
+    }
+    else if(glyph_index_mode) {
+        std::string invalid_item;
+        if(not parse_glyph_ids(glyph_id_file, main_face->num_glyphs, glyph_ids, invalid_item)) {
+            std::cout << "Error: The glyph indices file contains an invalid index or range (" << invalid_item << "), the font has "
+                      << main_face->num_glyphs << " glyphs.\n";
+            return EXIT_FAILURE;
+        }
+    }
 
     /* at this point, all command line arguments are validated, so let's work,
     * but first we must handle -verify
     */
     if(cli_args.verify) {
-        std::filesystem::path char_file_path {exe_dir};
-        char_file_path.append(cli_args.char_file);
-        std::ifstream char_file {char_file_path};
-        if(not char_file) {
-            std::cout << "Error: Couldn't open the characters file.\n";
-            return EXIT_FAILURE;
+        std::string missing_characters;
+        for(const Char_file_entry& entry : char_file.characters()) {
+            FT_UInt glyph_index = 0;
+            if(find_face(m_font_faces, entry.code_point, glyph_index) != -1) continue;
+            utf8::append(entry.code_point, std::back_inserter(missing_characters));
+            missing_characters.append(1, '\n');
         }
         std::filesystem::path missing_characters_file_path {exe_dir};
         missing_characters_file_path.append(std::u8string {u8"output/missing-chars.txt"});
@@ -358,35 +1512,9 @@ int App::run(int argc, char** argv)
             std::cout << "Internal error: The missing characters file couldn't be created.\n";
             return EXIT_FAILURE;
         }
-        std::string line;
-        int32 line_number = 1; // just for a better error message
-        while(std::getline(char_file, line)) {
-            if(line.empty()) continue;
-
-            if(not utf8::is_valid(line)) {
-                std::cout << "Error: Invalid UTF-8 found in the characters file at line #" << line_number << ".\n";
-                return EXIT_FAILURE;
-            }
-
-            std::u32string code_points {utf8::utf8to32(line)};
-            for(const char32_t code_point : code_points) {
-                if(FT_Get_Char_Index(m_font_face, code_point) == 0) {
-                    std::u32string u32str;
-                    u32str.append(1, code_point);
-                    std::u8string u8str {utf8::utf32tou8(u32str)};
-                    missing_characters_file.write(reinterpret_cast<const char*>(u8str.data()), u8str.size());
-                    missing_characters_file.put(static_cast<char>(u8'\n'));
-                    if(not missing_characters_file.good()) {
-                        std::cout << "Internal error: Writing to the missing characters file failed.\n";
-                        return EXIT_FAILURE;
-                    }
-                }
-            }
-
-            ++line_number;
-        }
-        if(not char_file.eof()) {
-            std::cout << "Internal error: An error ocurred while reading the characters file.\n";
+        missing_characters_file.write(missing_characters.data(), missing_characters.size());
+        if(not missing_characters_file.good()) {
+            std::cout << "Internal error: Writing to the missing characters file failed.\n";
             return EXIT_FAILURE;
         }
 
@@ -394,25 +1522,66 @@ int App::run(int argc, char** argv)
         return EXIT_SUCCESS;
     }
 
-    /* extract the desired characters' metrics */
+    /* with -update, the glyphs of the previous run keep their places and are not rendered again */
 
     std::map<char32_t, Char_info> characters;
+    std::map<std::pair<char32_t, int>, Char_info> variant_characters; // the metrics of the -subpixel variants but the first
+    Previous_run previous;
+    if(cli_args.update) {
+        if(not read_previous_info(create_output_filename(cli_args.output_stem, 0, false), cli_args.image_size, static_cast<int>(m_font_faces.size()), cli_args.subpixel, cli_args.allow_rotation, characters, variant_characters, previous)) {
+            return EXIT_FAILURE;
+        }
+        if(previous.linespace != (main_face->size->metrics.height >> 6)) {
+            std::cout << "Error: The previous run used a different font or -font-size.\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* extract the desired characters' metrics, each glyph is rendered and packed only once */
+
+    uint64 metrics_total = char_file.characters().size() + glyph_ids.size();
+    for(int face = 0; whole_font and face < static_cast<int>(m_font_faces.size()); ++face) metrics_total += count_char_codes(m_font_faces[face]);
+    begin_phase("metrics", metrics_total);
+
+    Glyph_sharing sharing;
+    for(const Rect& r : previous.glyph_rects) {
+        if(r.variant != 0) continue;
+        const int face = characters[r.code_point].face;
+        sharing.owners.emplace(std::pair {face, FT_Get_Char_Index(m_font_faces[face], r.code_point)}, r.code_point);
+    }
     std::vector<Rect> glyph_rects; glyph_rects.reserve(256);
-    const FT_Int32 load_flag = cli_args.load_vert_metrics ? FT_LOAD_VERTICAL_LAYOUT : FT_LOAD_DEFAULT;
-    FT_Render_Mode render_mode = cli_args.sdf ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL;
-    if(cli_args.char_file.empty()) {
+    // MSDF glyphs need outlines, so embedded bitmaps are never loaded for them
+    const FT_Int32 bitmap_flag = cli_args.msdf ? FT_LOAD_NO_BITMAP : FT_LOAD_DEFAULT;
+    const FT_Int32 load_flag = (cli_args.load_vert_metrics ? FT_LOAD_VERTICAL_LAYOUT : FT_LOAD_DEFAULT) | bitmap_flag;
+    FT_Render_Mode render_mode = cli_args.sdf ? FT_RENDER_MODE_SDF : (cli_args.lcd ? FT_RENDER_MODE_LCD : FT_RENDER_MODE_NORMAL);
+    Sdf_generator sdf_generator {m_freetype_library, cli_args.sdf_spread};
+    Sdf_generator* native_sdf = cli_args.native_sdf ? &sdf_generator : nullptr;
+    Msdf_shape msdf_shape;
+    Msdf_shape* msdf = cli_args.msdf ? &msdf_shape : nullptr;
+    const int channels = (cli_args.msdf or cli_args.lcd) ? 3 : 1;
+    Glyph_bitmap glyph_bitmap;
+    glyph_bitmap.spread = cli_args.sdf_spread;
+    // with a fallback chain, every font adds the characters that the fonts before it lack
+    for(int face = 0; whole_font and face < static_cast<int>(m_font_faces.size()); ++face) {
+        FT_Face font_face = m_font_faces[face];
         FT_ULong charcode = 0;
         FT_UInt glyph_index = 0;
 
-        charcode = FT_Get_First_Char(m_font_face, &glyph_index);
+        charcode = FT_Get_First_Char(font_face, &glyph_index);
         while(glyph_index != 0) {
-            error = FT_Load_Glyph(m_font_face, glyph_index, load_flag);
+            count_processed_glyph();
+            if(characters.contains(charcode) or share_glyph_by_index(sharing, face, glyph_index, charcode, characters)) {
+                charcode = FT_Get_Next_Char(font_face, charcode, &glyph_index);
+                continue;
+            }
+
+            error = FT_Load_Glyph(font_face, glyph_index, load_flag);
             if(error) {
                 std::cout << "Internal error: Couldn't load the glyph with character code " << charcode << ".\n";
                 return EXIT_FAILURE;
             }
 
-            error = FT_Render_Glyph(m_font_face->glyph, render_mode);
+            error = render_glyph(font_face->glyph, render_mode, native_sdf, msdf, glyph_bitmap);
             if(error) {
                 std::cout << "Internal error: Couldn't render the glyph with character code " << charcode << ".\n";
                 return EXIT_FAILURE;
@@ -420,14 +1589,20 @@ int App::run(int argc, char** argv)
 
             Char_info ci;
             ci.code_point = charcode;
-            ci.glyph_width = m_font_face->glyph->bitmap.width;
-            ci.glyph_height = m_font_face->glyph->bitmap.rows;
-            ci.left_bearing = m_font_face->glyph->bitmap_left;
-            ci.top_bearing = m_font_face->glyph->bitmap_top;
-            ci.advance_x = m_font_face->glyph->advance.x >> 6;
-            ci.advance_y = m_font_face->glyph->advance.y >> 6;
+            ci.glyph_width = glyph_bitmap.width;
+            ci.glyph_height = glyph_bitmap.rows;
+            ci.left_bearing = glyph_bitmap.left;
+            ci.top_bearing = glyph_bitmap.top;
+            ci.advance_x = font_face->glyph->advance.x >> 6;
+            ci.advance_y = font_face->glyph->advance.y >> 6;
+            ci.face = face;
 
             characters.emplace(charcode, ci);
+            if(cli_args.dedup_bitmaps and share_glyph_by_bitmap(sharing, face, glyph_index, charcode, glyph_bitmap)) {
+                charcode = FT_Get_Next_Char(font_face, charcode, &glyph_index);
+                continue;
+            }
+            sharing.owners.emplace(std::pair {face, glyph_index}, charcode);
 
             Rect r;
             r.code_point = charcode;
@@ -435,168 +1610,333 @@ int App::run(int argc, char** argv)
             r.h = ci.glyph_height;
 
             glyph_rects.push_back(r);
+            error = add_subpixel_variants(font_face, glyph_index, load_flag, cli_args.subpixel, ci, render_mode, native_sdf, msdf, glyph_bitmap, variant_characters, glyph_rects);
+            if(error) {
+                std::cout << "Internal error: Couldn't render the glyph with character code " << charcode << ".\n";
+                return EXIT_FAILURE;
+            }
 
-            charcode = FT_Get_Next_Char(m_font_face, charcode, &glyph_index);
+            charcode = FT_Get_Next_Char(font_face, charcode, &glyph_index);
         }
     }
-    else {
-        std::filesystem::path char_file_path {exe_dir};
-        char_file_path.append(cli_args.char_file);
-        std::ifstream char_file {char_file_path};
-        if(not char_file) {
-            std::cout << "Error: Couldn't open the characters file.\n";
+    for(const Char_file_entry& entry : char_file.characters()) {
+        count_processed_glyph();
+        const char32_t code_point = entry.code_point;
+        if(characters.contains(code_point)) continue;
+
+        FT_UInt glyph_index = 0;
+        const int face = find_face(m_font_faces, code_point, glyph_index);
+        if(face == -1) {
+            if(entry.line_number == 0) continue; // -ranges may cover code points that the fonts lack
+            if(fallback_chain) std::cout << "Error: None of the font files contain " << describe_character(entry) << ".\n";
+            else std::cout << "Error: The font file does not contain " << describe_character(entry) << ".\n";
             return EXIT_FAILURE;
         }
+        if(share_glyph_by_index(sharing, face, glyph_index, code_point, characters)) continue;
+        FT_Face font_face = m_font_faces[face];
 
-        std::string line;
-        int32 line_number = 1; // just for a better error message
-        while(std::getline(char_file, line)) {
-            if(line.empty()) continue;
-
-            if(not utf8::is_valid(line)) {
-                std::cout << "Error: Invalid UTF-8 found in the characters file at line #" << line_number << ".\n";
-                return EXIT_FAILURE;
-            }
-
-            int32 char_number = 1; // just for a better error message
-            std::u32string code_points = utf8::utf8to32(line);
-            for(const char32_t code_point : code_points) {
-                if(characters.contains(code_point)) continue;
+        error = FT_Load_Glyph(font_face, glyph_index, load_flag);
+        if(error) {
+            std::cout << "Internal error: Failed to load " << describe_character(entry) << ".\n";
+            return EXIT_FAILURE;
+        }
 
-                FT_UInt glyph_index = FT_Get_Char_Index(m_font_face, code_point);
-                if(glyph_index == 0u) {
-                    std::cout << "Error: The font file does not contain the character #" << char_number << " in the line #" << line_number << ".\n";
-                    return EXIT_FAILURE;
-                }
+        error = render_glyph(font_face->glyph, render_mode, native_sdf, msdf, glyph_bitmap);
+        if(error) {
+            std::cout << "Internal error: Failed to render " << describe_character(entry) << ".\n";
+            return EXIT_FAILURE;
+        }
 
-                error = FT_Load_Glyph(m_font_face, glyph_index, load_flag);
-                if(error) {
-                    std::cout << "Internal error: Failed to load the character #" << char_number << " in the line #" << line_number << ".\n";
-                    return EXIT_FAILURE;
-                }
+        Char_info ci;
+        ci.code_point = code_point;
+        ci.glyph_width = glyph_bitmap.width;
+        ci.glyph_height = glyph_bitmap.rows;
+        ci.left_bearing = glyph_bitmap.left;
+        ci.top_bearing = glyph_bitmap.top;
+        ci.advance_x = font_face->glyph->advance.x >> 6;
+        ci.advance_y = font_face->glyph->advance.y >> 6;
+        ci.face = face;
 
-                error = FT_Render_Glyph(m_font_face->glyph, render_mode);
-                if(error) {
-                    std::cout << "Internal error: Failed to render the character #" << char_number << " in the line #" << line_number << ".\n";
-                    return EXIT_FAILURE;
-                }
+        characters.emplace(code_point, ci);
+        if(cli_args.dedup_bitmaps and share_glyph_by_bitmap(sharing, face, glyph_index, code_point, glyph_bitmap)) continue;
+        sharing.owners.emplace(std::pair {face, glyph_index}, code_point);
 
-                ++char_number;
+        Rect r;
+        r.code_point = code_point;
+        r.w = ci.glyph_width;
+        r.h = ci.glyph_height;
 
-                Char_info ci;
-                ci.code_point = code_point;
-                ci.glyph_width = m_font_face->glyph->bitmap.width;
-                ci.glyph_height = m_font_face->glyph->bitmap.rows;
-                ci.left_bearing = m_font_face->glyph->bitmap_left;
-                ci.top_bearing = m_font_face->glyph->bitmap_top;
-                ci.advance_x = m_font_face->glyph->advance.x >> 6;
-                ci.advance_y = m_font_face->glyph->advance.y >> 6;
+        glyph_rects.push_back(r);
+        error = add_subpixel_variants(font_face, glyph_index, load_flag, cli_args.subpixel, ci, render_mode, native_sdf, msdf, glyph_bitmap, variant_characters, glyph_rects);
+        if(error) {
+            std::cout << "Internal error: Failed to render " << describe_character(entry) << ".\n";
+            return EXIT_FAILURE;
+        }
+    }
+    // with -glyph-ids, the glyph indices take the place of the code points from here on
+    for(const FT_UInt glyph_index : glyph_ids) {
+        count_processed_glyph();
+        error = FT_Load_Glyph(main_face, glyph_index, load_flag);
+        if(error) {
+            std::cout << "Internal error: Failed to load the glyph with index " << glyph_index << ".\n";
+            return EXIT_FAILURE;
+        }
 
-                characters.emplace(code_point, ci);
+        error = render_glyph(main_face->glyph, render_mode, native_sdf, msdf, glyph_bitmap);
+        if(error) {
+            std::cout << "Internal error: Failed to render the glyph with index " << glyph_index << ".\n";
+            return EXIT_FAILURE;
+        }
 
-                Rect r;
-                r.code_point = code_point;
-                r.w = ci.glyph_width;
-                r.h = ci.glyph_height;
+        Char_info ci;
+        ci.code_point = glyph_index;
+        ci.glyph_width = glyph_bitmap.width;
+        ci.glyph_height = glyph_bitmap.rows;
+        ci.left_bearing = glyph_bitmap.left;
+        ci.top_bearing = glyph_bitmap.top;
+        ci.advance_x = main_face->glyph->advance.x >> 6;
+        ci.advance_y = main_face->glyph->advance.y >> 6;
+        characters.emplace(glyph_index, ci);
 
-                glyph_rects.push_back(r);
-            }
+        Rect r;
+        r.code_point = glyph_index;
+        r.w = ci.glyph_width;
+        r.h = ci.glyph_height;
 
-            ++line_number;
-        }
-        if(not char_file.eof()) {
-            std::cout << "Internal error: An error ocurred while reading the characters file.\n";
+        glyph_rects.push_back(r);
+        error = add_subpixel_variants(main_face, glyph_index, load_flag, cli_args.subpixel, ci, render_mode, native_sdf, msdf, glyph_bitmap, variant_characters, glyph_rects);
+        if(error) {
+            std::cout << "Internal error: Failed to render the glyph with index " << glyph_index << ".\n";
             return EXIT_FAILURE;
         }
     }
 
+    if(cli_args.update and glyph_rects.empty()) {
+        std::cout << "There are no new characters, the atlases are already up to date.\n";
+        return EXIT_SUCCESS;
+    }
+
     /* find the optimal places for the glyphs to be put within the image */
 
-    Bin bin {cli_args.image_size, cli_args.image_size, cli_args.multiple_images};
+    begin_phase("packing", 0);
+
     if(not cli_args.as_given) std::sort(glyph_rects.begin(), glyph_rects.end(), compare_rects);
-    try { bin.layout_bulk(glyph_rects); }
-    catch(const std::runtime_error& e) {
-        std::cout << e.what() << '\n';
-        return EXIT_FAILURE;
+    std::vector<Rect> placed_rects; placed_rects.reserve(glyph_rects.size());
+    Bin_stats packer_stats; // the pages of every bin, in atlas order
+    if(not heuristics[cli_args.heuristic].pack(cli_args, previous, glyph_rects, placed_rects, packer_stats)) return EXIT_FAILURE;
+    if(cli_args.packer_stats) {
+        // a bin that received nothing (with -update, everything may fit in the previous atlases) isn't an atlas
+        int atlas_count = previous.bin_count;
+        for(const Rect& r : placed_rects) atlas_count = std::max(atlas_count, r.bin + 1);
+        packer_stats.pages.resize(atlas_count);
+        if(not write_packer_stats(cli_args.output_stem, packer_stats, cli_args.image_size)) return EXIT_FAILURE;
     }
-    if(bin.processed_rectangles() == 0) {
-        std::cout << "Error: -font-size is too large for -image-size\n";
+    if(placed_rects.empty()) {
+        if(cli_args.update) std::cout << "Error: There is no space left in the atlases for the new characters.\n";
+        else std::cout << "Error: -font-size is too large for -image-size\n";
         return EXIT_FAILURE;
     }
 
     /* pack the glyphs' textures and information */
 
-    int current_bin_instance = 0;
-    const int processed_rectangles = bin.processed_rectangles();
-    std::ofstream info_file {create_output_filename(cli_args.output_stem, current_bin_instance, false), std::ios_base::binary};
+    begin_phase("atlases", placed_rects.size());
+
+    std::ofstream info_file {create_output_filename(cli_args.output_stem, 0, false), std::ios_base::binary};
     if(not info_file) {
         std::cout << "Internal error: Couldn't create the information output file.\n";
         return EXIT_FAILURE;
     }
     info_file << "atlas-dimensions:" << std::to_string(cli_args.image_size) << '\n';
-    info_file << "linespace:" << std::to_string(m_font_face->size->metrics.height >> 6) << '\n';
-    // add the information and generate the image of the .notdef glyph before the other glyphs
-    error = FT_Load_Glyph(m_font_face, 0u, load_flag);
-    if(error) {
-        std::cout << "Internal error: Failed to load the .notdef glyph.\n";
-        return EXIT_FAILURE;
-    }
-    error = FT_Render_Glyph(m_font_face->glyph, render_mode);
-    if(error) {
-        std::cout << "Internal error: Failed to render the .notdef glyph.\n";
-        return EXIT_FAILURE;
+    info_file << "linespace:" << std::to_string(main_face->size->metrics.height >> 6) << '\n';
+    if(glyph_index_mode) info_file << "glyph-count:" << std::to_string(main_face->num_glyphs) << '\n';
+    if(cli_args.update) { // the .notdef glyph and the glyphs of the previous run stay as they were
+        info_file << previous.notdef_line << '\n';
+        for(const Rect& r : previous.glyph_rects) place_shared_char_info(info_file, r, characters, variant_characters, sharing, info_columns);
     }
-    std::string notdef_info {std::to_string(m_font_face->glyph->bitmap_left)};
-    notdef_info.append(1, ':').append(std::to_string(m_font_face->glyph->bitmap_top));
-    notdef_info.append(1, ':').append(std::to_string(m_font_face->glyph->advance.x >> 6));
-    notdef_info.append(1, ':').append(std::to_string(m_font_face->glyph->advance.y >> 6));
-    info_file << "notdef:" << notdef_info << '\n';
+    else {
+        // add the information and generate the image of the .notdef glyph before the other glyphs
+        error = FT_Load_Glyph(main_face, 0u, load_flag);
+        if(error) {
+            std::cout << "Internal error: Failed to load the .notdef glyph.\n";
+            return EXIT_FAILURE;
+        }
+        error = render_glyph(main_face->glyph, render_mode, native_sdf, msdf, glyph_bitmap);
+        if(error) {
+            std::cout << "Internal error: Failed to render the .notdef glyph.\n";
+            return EXIT_FAILURE;
+        }
+        std::string notdef_info {std::to_string(glyph_bitmap.left)};
+        notdef_info.append(1, ':').append(std::to_string(glyph_bitmap.top));
+        notdef_info.append(1, ':').append(std::to_string(main_face->glyph->advance.x >> 6));
+        notdef_info.append(1, ':').append(std::to_string(main_face->glyph->advance.y >> 6));
+        info_file << "notdef:" << notdef_info << '\n';
 
-    std::vector<uint8> notdef_image;
-    if(not create_png_image(m_font_face->glyph->bitmap.width, m_font_face->glyph->bitmap.rows, m_font_face->glyph->bitmap.buffer, notdef_image)) {
-        return EXIT_FAILURE;
+        std::vector<uint8> notdef_pixels;
+        if(cli_args.msdf) {
+            notdef_pixels.resize(static_cast<std::size_t>(glyph_bitmap.width) * glyph_bitmap.rows * 3);
+            Msdf_scratch scratch;
+            msdf_shape.generate(notdef_pixels.data(), glyph_bitmap.pitch, scratch);
+            glyph_bitmap.buffer = notdef_pixels.data();
+        }
+        std::vector<uint8> notdef_image;
+        if(not create_png_image(glyph_bitmap.width, glyph_bitmap.rows, channels, glyph_bitmap.buffer, glyph_bitmap.pitch, notdef_image)) {
+            return EXIT_FAILURE;
+        }
+        std::filesystem::path notdef_path {exe_dir};
+        notdef_path.append(std::string {"output/"} + cli_args.output_stem + "-notdef.png");
+        std::ofstream notdef_image_file {notdef_path, std::ios_base::binary};
+        if(not notdef_image_file) {
+            std::cout << "Error: Couldn't open a file to write the image for the .notdef glyph.\n";
+            return EXIT_FAILURE;
+        }
+        notdef_image_file.write(reinterpret_cast<char*>(notdef_image.data()), notdef_image.size());
+        if(notdef_image_file.fail() or notdef_image_file.bad()) {
+            std::cout << "Internal error: Writing a png image file for the .notdef glyph failed.\n";
+            return EXIT_FAILURE;
+        }
+        notdef_image_file.close();
     }
-    std::filesystem::path notdef_path {exe_dir};
-    notdef_path.append(std::string {"output/"} + cli_args.output_stem + "-notdef.png");
-    std::ofstream notdef_image_file {notdef_path, std::ios_base::binary};
-    if(not notdef_image_file) {
-        std::cout << "Error: Couldn't open a file to write the image for the .notdef glyph.\n";
-        return EXIT_FAILURE;
+    // generate the atlases, only the ones that received glyphs are written
+    std::stable_sort(placed_rects.begin(), placed_rects.end(), [](const Rect& lhs, const Rect& rhs) { return lhs.bin < rhs.bin; });
+    if(not glyph_index_mode) {
+        for(const Rect& r : placed_rects) place_shared_char_info(info_file, r, characters, variant_characters, sharing, info_columns);
     }
-    notdef_image_file.write(reinterpret_cast<char*>(notdef_image.data()), notdef_image.size());
-    if(notdef_image_file.fail() or notdef_image_file.bad()) {
-        std::cout << "Internal error: Writing a png image file for the .notdef glyph failed.\n";
-        return EXIT_FAILURE;
+    // with -max-memory, the atlases are generated strip by strip from the top, see Atlas_strips
+    if(cli_args.max_memory) {
+        std::stable_sort(placed_rects.begin(), placed_rects.end(), [](const Rect& lhs, const Rect& rhs) { return lhs.bin != rhs.bin ? lhs.bin < rhs.bin : lhs.y < rhs.y; });
     }
-    notdef_image_file.close();
-    // generate the atlases
-    std::vector<uint8> atlas; atlas.resize(cli_args.image_size * cli_args.image_size);
-    for(int i = 0; i < processed_rectangles; ++i) {
-        const Rect& r = glyph_rects[i];
+    const std::size_t atlas_size = static_cast<std::size_t>(cli_args.image_size) * cli_args.image_size * channels;
+    int tallest = 0;
+    for(const Rect& r : placed_rects) tallest = std::max(tallest, r.h);
+    Atlas_strips strips {cli_args.image_size, channels, tallest};
+    const std::size_t memory_limit = static_cast<std::size_t>(cli_args.max_memory) << 20;
+    std::size_t msdf_budget = 0; // what the MSDF shapes waiting for the band may use
+    if(cli_args.max_memory) {
+        /* the peak of the whole run: the font files, the glyphs' information and rects (glyph_rects was
+        * alive along placed_rects since the metrics phase), the bitmaps kept by -dedup-bitmaps, the most
+        * FreeType ever held and the band of an atlas; the MSDF shapes get what is left, see below
+        */
+        std::size_t needed = strips.band_size() + (glyph_rects.capacity() + placed_rects.capacity()) * sizeof(Rect);
+        glyph_rects = std::vector<Rect> {}; // the ones that were placed have been copied to placed_rects
+        for(const std::vector<uint8>& in_memory_font_file : in_memory_font_files) needed += in_memory_font_file.size();
+        needed += (characters.size() + variant_characters.size()) * (sizeof(Char_info) + map_node_overhead);
+        for(const auto& [hash, owned] : sharing.bitmap_owners) needed += sizeof(Owned_bitmap) + map_node_overhead + owned.pixels.capacity();
+        needed += m_freetype_memory_pool.peak_size();
+        if(needed > memory_limit) {
+            std::cout << "Error: -max-memory is too small for these characters and -image-size, at least " << ((needed + (1 << 20) - 1) >> 20) << " MiB are needed.\n";
+            return EXIT_FAILURE;
+        }
+        msdf_budget = memory_limit - needed;
+    }
+    Atlas_page atlas; // without -max-memory, the whole atlas
+    std::vector<std::pair<Rect, Msdf_shape>> msdf_glyphs;
+    std::size_t msdf_glyphs_size = 0;
+    auto pixels = [&] { return cli_args.max_memory ? strips.data() : atlas.data(); };
+    auto generate_msdf = [&] {
+        generate_msdf_glyphs(pixels(), cli_args.image_size, msdf_glyphs);
+        msdf_glyphs.clear();
+        msdf_glyphs_size = 0;
+    };
+    auto finish_atlas = [&](const int bin_instance) {
+        generate_msdf();
+        if(cli_args.max_memory) return strips.finish();
+        return create_png_image(cli_args.output_stem, bin_instance, cli_args.image_size, channels, atlas.data());
+    };
+    int current_bin_instance = -1;
+    for(const Rect& r : placed_rects) {
         if(r.bin != current_bin_instance) {
-            if(not create_png_image(cli_args.output_stem, current_bin_instance, cli_args.image_size, atlas.data())) {
-                return EXIT_FAILURE;
+            if(current_bin_instance != -1 and not finish_atlas(current_bin_instance)) return EXIT_FAILURE;
+            current_bin_instance = r.bin;
+            const std::filesystem::path atlas_path {create_output_filename(cli_args.output_stem, current_bin_instance, true)};
+            if(cli_args.max_memory) {
+                if(not strips.begin(atlas_path, current_bin_instance < previous.bin_count ? atlas_path : std::filesystem::path {})) return EXIT_FAILURE;
+            }
+            else {
+                const bool fresh_atlas = atlas.data() == nullptr;
+                if(fresh_atlas and not atlas.allocate(atlas_size)) {
+                    std::cout << "Error: Couldn't allocate the memory for an atlas.\n";
+                    return EXIT_FAILURE;
+                }
+                if(current_bin_instance < previous.bin_count) {
+                    if(not load_png_image(atlas_path, cli_args.image_size, channels, atlas.data())) return EXIT_FAILURE;
+                }
+                else if(not fresh_atlas and not atlas.allocate(atlas_size)) { // zero pages again, see Atlas_page
+                    std::cout << "Error: Couldn't allocate the memory for an atlas.\n";
+                    return EXIT_FAILURE;
+                }
             }
-            std::memset(atlas.data(), 0, atlas.size());
-            ++current_bin_instance;
         }
-        error = FT_Load_Char(m_font_face, r.code_point, FT_LOAD_DEFAULT);
+        // the rows above the glyph are final, the glyphs of the band must be complete before they are encoded
+        if(cli_args.max_memory and not strips.holds(r.y + r.h)) {
+            generate_msdf();
+            if(not strips.advance(r.y)) return EXIT_FAILURE;
+        }
+        Rect where = r; // in the band with -max-memory
+        if(cli_args.max_memory) where.y -= strips.top();
+        FT_Face font_face = m_font_faces[characters[r.code_point].face];
+        if(glyph_index_mode) error = FT_Load_Glyph(font_face, r.code_point, bitmap_flag);
+        else error = FT_Load_Char(font_face, r.code_point, bitmap_flag);
         if(error) {
             std::cout << "Internal error: Failed to load the character with code point " << static_cast<uint32>(r.code_point) << ".\n";
             return EXIT_FAILURE;
         }
-        error = FT_Render_Glyph(m_font_face->glyph, render_mode);
+        shift_outline(font_face->glyph, r.variant, cli_args.subpixel);
+        const bool in_place = not r.rotated and can_render_in_place(font_face->glyph, render_mode, native_sdf, msdf);
+        if(in_place) {
+            const Char_info& ci = r.variant == 0 ? characters[r.code_point] : variant_characters[{r.code_point, r.variant}];
+            error = render_in_place(m_freetype_library, font_face->glyph, pixels(), cli_args.image_size, where, ci.left_bearing, ci.top_bearing);
+        }
+        else error = render_glyph(font_face->glyph, render_mode, native_sdf, msdf, glyph_bitmap);
         if(error) {
             std::cout << "Internal error: Couldn't render the glyph with character code " << static_cast<uint32>(r.code_point) << ".\n";
             return EXIT_FAILURE;
         }
-        place_pixel_data(atlas, cli_args.image_size, r, m_font_face->glyph->bitmap.buffer, r.w);
-        place_char_info(info_file, r, characters[r.code_point]);
+        if(cli_args.msdf) {
+            // the glyphs waiting are all in the band, they can be generated early to stay within -max-memory
+            const std::size_t shape_size = sizeof(std::pair<Rect, Msdf_shape>) + msdf_shape.memory_size();
+            if(cli_args.max_memory and msdf_glyphs_size + shape_size > msdf_budget) generate_msdf();
+            msdf_glyphs.emplace_back(where, msdf_shape);
+            msdf_glyphs_size += shape_size;
+        }
+        else if(r.rotated) place_rotated_pixel_data(pixels(), cli_args.image_size, where, glyph_bitmap);
+        else if(not in_place) place_pixel_data(pixels(), cli_args.image_size, where, glyph_bitmap);
+        if(not cli_args.msdf) count_processed_glyph(); // the MSDF glyphs are counted as they are generated
     }
-    if(not create_png_image(cli_args.output_stem, current_bin_instance, cli_args.image_size, atlas.data())) {
+    if(not finish_atlas(current_bin_instance)) return EXIT_FAILURE;
+    if(glyph_index_mode) place_glyph_info(info_file, placed_rects, characters, variant_characters, main_face->num_glyphs, cli_args.subpixel, info_columns);
+    info_file.close();
+    if(not info_file) {
+        std::cout << "Internal error: Writing the information output file failed.\n";
         return EXIT_FAILURE;
     }
 
+    // the kerning of every character, the ones of a previous run included
+    if(cli_args.kerning) {
+        begin_phase("kerning", 0);
+        std::vector<Kerning_glyph> kerning_glyphs; kerning_glyphs.reserve(characters.size());
+        for(const auto& [code_point, ci] : characters) {
+            const FT_UInt glyph_index = glyph_index_mode ? static_cast<FT_UInt>(code_point) : FT_Get_Char_Index(m_font_faces[ci.face], code_point);
+            kerning_glyphs.push_back({code_point, glyph_index, ci.face});
+        }
+        std::vector<Kerning_pair> kerning_pairs;
+        if(not compute_kerning(in_memory_font_files, cli_args.font_size, kerning_glyphs, kerning_pairs)) {
+            std::cout << "Internal error: Computing the kerning pairs failed.\n";
+            return EXIT_FAILURE;
+        }
+        if(not write_kerning_file(cli_args.output_stem, kerning_pairs)) return EXIT_FAILURE;
+    }
+
+    const int bin_count = std::max(previous.bin_count, placed_rects.back().bin + 1);
+    // -glyph-ids and -char-file can't be used together, either file is the list of what to generate
+    const std::filesystem::path& list_file_path = glyph_index_mode ? glyph_id_file_path : char_file_path;
+    if(not write_stamp_and_depfile(cli_args.output_stem, input_hash, bin_count, cli_args.kerning, font_file_paths, list_file_path)) {
+        return EXIT_FAILURE;
+    }
+
+    if(cli_args.alloc_stats) {
+        std::cout << "phase:allocations:bytes:freetype-allocations:freetype-bytes:peak-rss-kib\n" << alloc_report.finish();
+    }
+    if(cli_args.progress) progress.finish();
     std::cout << "Finished generating files.\n";
     return EXIT_SUCCESS;
 }
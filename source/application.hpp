@@ -1,8 +1,12 @@
 #pragma once
 
+#include <vector>
+
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+#include "ft_memory_pool.hpp"
+
 class App {
 public:
     App() noexcept {};
@@ -10,6 +14,7 @@ public:
 
     int run(int argc, char** argv);
 private:
+    Ft_memory_pool m_freetype_memory_pool; // declared first, it must outlive the library
     FT_Library m_freetype_library = nullptr;
-    FT_Face m_font_face = nullptr;
+    std::vector<FT_Face> m_font_faces; // the fallback chain, in the order given to -font
 };
\ No newline at end of file
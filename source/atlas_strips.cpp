@@ -0,0 +1,227 @@
+#include "atlas_strips.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <system_error>
+
+#include "progress.hpp"
+
+namespace {
+
+std::FILE* open_file(const std::filesystem::path& path, const bool write) noexcept
+{
+#ifdef _WIN32
+    return _wfopen(path.c_str(), write ? L"wb" : L"rb");
+#else
+    return std::fopen(path.c_str(), write ? "wb" : "rb");
+#endif // _WIN32
+}
+
+} // namespace
+
+bool Png_row_writer::open(const std::filesystem::path& path, const int width, const int height, const int channels)
+{
+    close();
+    m_file = open_file(path, true);
+    if(not m_file) return false;
+    m_png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if(m_png) m_info = png_create_info_struct(m_png);
+    if(not m_info) return false;
+    if(setjmp(png_jmpbuf(m_png))) return false;
+    png_set_write_fn(m_png, m_file, write_data, flush_data);
+    png_set_IHDR(m_png, m_info, width, height, 8, channels == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_GRAY,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_sRGB(m_png, m_info, PNG_sRGB_INTENT_PERCEPTUAL); // what the simplified API writes
+    png_write_info(m_png, m_info);
+    m_row_size = static_cast<std::size_t>(width) * channels;
+    return true;
+}
+
+bool Png_row_writer::write_rows(const uint8* rows, const int count)
+{
+    if(setjmp(png_jmpbuf(m_png))) return false;
+    for(int i = 0; i < count; ++i) png_write_row(m_png, rows + i * m_row_size);
+    return true;
+}
+
+bool Png_row_writer::finish()
+{
+    if(setjmp(png_jmpbuf(m_png))) return false;
+    png_write_end(m_png, m_info);
+    png_destroy_write_struct(&m_png, &m_info);
+    const bool closed = std::fclose(m_file) == 0;
+    m_file = nullptr;
+    return closed;
+}
+
+// like libpng's own stdio functions, but the bytes are counted as they are written (-progress)
+void Png_row_writer::write_data(png_structp png, png_bytep data, png_size_t length)
+{
+    if(std::fwrite(data, 1, length, static_cast<std::FILE*>(png_get_io_ptr(png))) != length) png_error(png, "Write Error");
+    count_written_bytes(length);
+}
+
+void Png_row_writer::flush_data(png_structp png)
+{
+    std::fflush(static_cast<std::FILE*>(png_get_io_ptr(png)));
+}
+
+void Png_row_writer::close() noexcept
+{
+    if(m_png) png_destroy_write_struct(&m_png, m_info ? &m_info : nullptr);
+    if(m_file) std::fclose(m_file);
+    m_png = nullptr;
+    m_info = nullptr;
+    m_file = nullptr;
+}
+
+bool Png_row_reader::open(const std::filesystem::path& path, const int width, const int height, const int channels)
+{
+    close();
+    m_file = open_file(path, false);
+    if(not m_file) {
+        std::cout << "Error: Couldn't open the atlas " << path.filename().string() << " of the previous run.\n";
+        return false;
+    }
+    m_png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    if(m_png) m_info = png_create_info_struct(m_png);
+    if(not m_info) {
+        std::cout << "Internal error: png_create_read_struct failed.\n";
+        return false;
+    }
+    if(setjmp(png_jmpbuf(m_png))) {
+        std::cout << "Error: The atlas " << path.filename().string() << " of the previous run is not a valid PNG image.\n";
+        return false;
+    }
+    png_init_io(m_png, m_file);
+    png_read_info(m_png, m_info);
+    if(png_get_image_width(m_png, m_info) != static_cast<png_uint_32>(width) or png_get_image_height(m_png, m_info) != static_cast<png_uint_32>(height)) {
+        std::cout << "Error: The atlas " << path.filename().string() << " of the previous run doesn't match -image-size.\n";
+        return false;
+    }
+    if(png_get_interlace_type(m_png, m_info) != PNG_INTERLACE_NONE) { // its rows can't be read in order
+        std::cout << "Error: The atlas " << path.filename().string() << " of the previous run is interlaced, it can't be used with -max-memory.\n";
+        return false;
+    }
+    png_set_expand(m_png);
+    png_set_strip_16(m_png);
+    png_set_strip_alpha(m_png);
+    if(channels == 3) png_set_gray_to_rgb(m_png);
+    else png_set_rgb_to_gray_fixed(m_png, 1, -1, -1);
+    png_read_update_info(m_png, m_info);
+    m_row_size = static_cast<std::size_t>(width) * channels;
+    if(png_get_rowbytes(m_png, m_info) != m_row_size) {
+        std::cout << "Error: The atlas " << path.filename().string() << " of the previous run has an unexpected format.\n";
+        return false;
+    }
+    return true;
+}
+
+bool Png_row_reader::read_rows(uint8* rows, const int count)
+{
+    if(setjmp(png_jmpbuf(m_png))) {
+        std::cout << "Error: Failed to read an atlas of the previous run.\n";
+        return false;
+    }
+    for(int i = 0; i < count; ++i) png_read_row(m_png, rows + i * m_row_size, nullptr);
+    return true;
+}
+
+void Png_row_reader::close() noexcept
+{
+    if(m_png) png_destroy_read_struct(&m_png, m_info ? &m_info : nullptr, nullptr);
+    if(m_file) std::fclose(m_file);
+    m_png = nullptr;
+    m_info = nullptr;
+    m_file = nullptr;
+}
+
+Atlas_strips::Atlas_strips(const int image_size, const int channels, const int tallest) noexcept
+    : m_image_size {image_size}, m_channels {channels}, m_row_size {static_cast<std::size_t>(image_size) * channels},
+      m_band_rows {std::min(image_size, tallest + strip_rows)}
+{
+}
+
+bool Atlas_strips::begin(const std::filesystem::path& path, const std::filesystem::path& previous)
+{
+    m_band.resize(m_band_rows * m_row_size);
+    m_top = 0;
+    m_path = path;
+    m_from_previous = not previous.empty();
+    // the previous atlas is read while the new one is written, it usually is the same file
+    m_writing_path = m_from_previous ? std::filesystem::path {path}.concat(".part") : path;
+    if(m_from_previous and not m_reader.open(previous, m_image_size, m_image_size, m_channels)) return false;
+    if(not m_writer.open(m_writing_path, m_image_size, m_image_size, m_channels)) {
+        std::cout << "Internal error: Couldn't open a file stream to write the png image to.\n";
+        return false;
+    }
+    return fill(0, 0, m_band_rows);
+}
+
+bool Atlas_strips::advance(const int top)
+{
+    const int rows = top - m_top;
+    if(rows <= 0) return true;
+    if(rows > m_band_rows) {
+        // 'top' is below the band (with -update, the glyphs of the previous run fill the rows above
+        // the new ones): the band is final, and so are the rows down to 'top', encoded a band at a time
+        if(not encode(m_band_rows)) return false;
+        for(int row = m_top + m_band_rows; row < top; row += m_band_rows) {
+            const int count = std::min(m_band_rows, top - row);
+            if(not fill(0, row, count) or not encode(count)) return false;
+        }
+        m_top = top;
+        return fill(0, m_top, m_band_rows);
+    }
+    if(not encode(rows)) return false;
+    const int kept = m_band_rows - rows;
+    std::memmove(m_band.data(), m_band.data() + rows * m_row_size, kept * m_row_size);
+    m_top = top;
+    return fill(kept, m_top + kept, rows);
+}
+
+bool Atlas_strips::finish()
+{
+    const int band_rows = std::min(m_band_rows, m_image_size - m_top);
+    bool written = m_writer.write_rows(m_band.data(), band_rows);
+    // the rows below the band have no glyph, they are copied from the previous atlas or empty
+    for(int row = m_top + band_rows; written and row < m_image_size; ++row) {
+        if(not fill(0, row, 1)) return false;
+        written = m_writer.write_rows(m_band.data(), 1);
+    }
+    m_reader.close();
+    if(not written or not m_writer.finish()) {
+        std::cout << "Internal error: Writing a png image to a file failed.\n";
+        return false;
+    }
+    if(m_from_previous) {
+        std::error_code ec;
+        std::filesystem::rename(m_writing_path, m_path, ec);
+        if(ec) {
+            std::cout << "Internal error: Couldn't replace the atlas " << m_path.filename().string() << " of the previous run.\n";
+            return false;
+        }
+    }
+    count_encoded_page();
+    return true;
+}
+
+// writes the first 'count' rows of the band to the file
+bool Atlas_strips::encode(const int count)
+{
+    if(m_writer.write_rows(m_band.data(), count)) return true;
+    std::cout << "Internal error: Writing a png image to a file failed.\n";
+    return false;
+}
+
+// the band rows from 'band_row' receive the image rows from 'image_row', the ones past the image are cleared
+bool Atlas_strips::fill(const std::size_t band_row, const int image_row, const int count)
+{
+    uint8* rows = m_band.data() + band_row * m_row_size;
+    const int in_image = std::clamp(m_image_size - image_row, 0, count);
+    if(m_from_previous and not m_reader.read_rows(rows, in_image)) return false;
+    const int cleared_from = m_from_previous ? in_image : 0;
+    std::memset(rows + cleared_from * m_row_size, 0, (count - cleared_from) * m_row_size);
+    return true;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "png.h"
+
+#include "mystdint.hpp"
+
+/*
+PNG files written and read one row at a time with libpng's row functions, so that neither the
+image nor its encoding has to be whole in memory. The files are the same as the ones of the
+simplified API (create_png_image): 8 bits grey or RGB, with an sRGB chunk. libpng's errors are
+printed by libpng and turned into a false return value; the setjmp of each function only
+covers its libpng calls.
+*/
+class Png_row_writer {
+public:
+    Png_row_writer() noexcept {}
+    ~Png_row_writer() { close(); }
+    Png_row_writer(const Png_row_writer&) = delete;
+    Png_row_writer& operator=(const Png_row_writer&) = delete;
+
+    bool open(const std::filesystem::path& path, const int width, const int height, const int channels);
+    bool write_rows(const uint8* rows, const int count); // rows of width * channels bytes, without padding
+    bool finish(); // writes the end of the file and closes it
+private:
+    static void write_data(png_structp png, png_bytep data, png_size_t length);
+    static void flush_data(png_structp png);
+    void close() noexcept;
+
+    std::FILE* m_file = nullptr;
+    png_structp m_png = nullptr;
+    png_infop m_info = nullptr;
+    std::size_t m_row_size = 0;
+};
+
+// reads any non-interlaced PNG as 8 bits grey or RGB rows, like the simplified API would
+class Png_row_reader {
+public:
+    Png_row_reader() noexcept {}
+    ~Png_row_reader() { close(); }
+    Png_row_reader(const Png_row_reader&) = delete;
+    Png_row_reader& operator=(const Png_row_reader&) = delete;
+
+    // fails with an error message if the image isn't 'width' by 'height' pixels
+    bool open(const std::filesystem::path& path, const int width, const int height, const int channels);
+    bool read_rows(uint8* rows, const int count);
+    void close() noexcept;
+private:
+    std::FILE* m_file = nullptr;
+    png_structp m_png = nullptr;
+    png_infop m_info = nullptr;
+    std::size_t m_row_size = 0;
+};
+
+/*
+An atlas generated strip by strip (-max-memory): only a band of rows of the image is in memory,
+and it moves down the image as the glyphs, in increasing order of their top, are placed. When a
+glyph doesn't fit in the band, the rows above its top are final, so they are encoded and the
+band moves down to start at its top. The band holds the tallest glyph and 'strip_rows' more rows,
+a 32768 pixels RGB atlas with glyphs of 100 pixels needs 35 MiB instead of 3 GiB.
+
+With an atlas of a previous run (-update), its rows are read as the band reaches them and the new
+file replaces it once it is complete.
+*/
+class Atlas_strips {
+public:
+    static constexpr int strip_rows = 256;
+
+    // 'tallest' is the height of the tallest glyph of the atlases
+    Atlas_strips(const int image_size, const int channels, const int tallest) noexcept;
+
+    std::size_t band_size() const noexcept { return m_band_rows * m_row_size; }
+    // 'previous' is empty for a new atlas
+    bool begin(const std::filesystem::path& path, const std::filesystem::path& previous);
+    bool holds(const int bottom) const noexcept { return bottom <= m_top + m_band_rows; }
+    bool advance(const int top); // encodes the rows above 'top', the band then starts at 'top'
+    bool finish(); // encodes the rest of the image
+    uint8* data() noexcept { return m_band.data(); } // the row 'top()' of the atlas
+    int top() const noexcept { return m_top; }
+private:
+    bool encode(const int count);
+    bool fill(const std::size_t band_row, const int image_row, const int count);
+
+    const int m_image_size;
+    const int m_channels;
+    const std::size_t m_row_size;
+    const int m_band_rows;
+    std::vector<uint8> m_band;
+    int m_top = 0;
+    std::filesystem::path m_path;
+    std::filesystem::path m_writing_path;
+    bool m_from_previous = false;
+    Png_row_writer m_writer;
+    Png_row_reader m_reader;
+};
@@ -0,0 +1,292 @@
+#include "charfile.hpp"
+
+#include <cstring>
+#include <span>
+#include <bit>
+#include <algorithm>
+#include <iterator>
+
+#ifdef _WIN32
+#include "mywindows.h"
+#endif // _WIN32
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // __linux__
+
+namespace {
+
+constexpr uint64 ones = 0x0101010101010101ull;
+constexpr uint64 high_bits = 0x8080808080808080ull;
+
+// true if any of the 8 bytes of 'word' equals 'byte' (the usual SWAR zero byte test)
+constexpr bool has_byte(const uint64 word, const uint8 byte) noexcept
+{
+    const uint64 x = word ^ (ones * byte);
+    return ((x - ones) & ~x & high_bits) != 0;
+}
+
+bool is_continuation(const uint8 byte) noexcept
+{
+    return (byte & 0xC0) == 0x80;
+}
+
+/* decodes the multi-byte sequence at 'p' (its lead byte is not ASCII), returns its length or 0
+* if it isn't valid UTF-8
+*/
+int decode(const uint8* p, const uint8* end, char32_t& code_point) noexcept
+{
+    const uint8 lead = p[0];
+    const std::ptrdiff_t available = end - p;
+    if(lead >= 0xC2 and lead <= 0xDF) {
+        if(available < 2 or not is_continuation(p[1])) return 0;
+        code_point = ((lead & 0x1Fu) << 6) | (p[1] & 0x3Fu);
+        return 2;
+    }
+    if(lead >= 0xE0 and lead <= 0xEF) {
+        if(available < 3 or not is_continuation(p[1]) or not is_continuation(p[2])) return 0;
+        if(lead == 0xE0 and p[1] < 0xA0) return 0; // overlong
+        if(lead == 0xED and p[1] > 0x9F) return 0; // surrogate
+        code_point = ((lead & 0x0Fu) << 12) | ((p[1] & 0x3Fu) << 6) | (p[2] & 0x3Fu);
+        return 3;
+    }
+    if(lead >= 0xF0 and lead <= 0xF4) {
+        if(available < 4 or not is_continuation(p[1]) or not is_continuation(p[2]) or not is_continuation(p[3])) return 0;
+        if(lead == 0xF0 and p[1] < 0x90) return 0; // overlong
+        if(lead == 0xF4 and p[1] > 0x8F) return 0; // above U+10FFFF
+        code_point = ((lead & 0x07u) << 18) | ((p[1] & 0x3Fu) << 12) | ((p[2] & 0x3Fu) << 6) | (p[3] & 0x3Fu);
+        return 4;
+    }
+    return 0; // a stray continuation byte, or a lead byte that is never valid
+}
+
+struct Code_point_range {
+    char32_t first;
+    char32_t last;
+};
+
+// the presets of -ranges, the blocks are the ones of the Unicode standard
+constexpr Code_point_range ascii[] {{0x20, 0x7E}};
+constexpr Code_point_range latin_1[] {{0x20, 0x7E}, {0xA0, 0xFF}};
+constexpr Code_point_range latin_extended[] {{0x100, 0x24F}, {0x1E00, 0x1EFF}};
+constexpr Code_point_range greek[] {{0x370, 0x3FF}};
+constexpr Code_point_range cyrillic[] {{0x400, 0x52F}};
+constexpr Code_point_range hebrew[] {{0x590, 0x5FF}};
+constexpr Code_point_range arabic[] {{0x600, 0x6FF}};
+constexpr Code_point_range thai[] {{0xE00, 0xE7F}};
+constexpr Code_point_range punctuation[] {{0x2000, 0x206F}, {0x20A0, 0x20CF}};
+constexpr Code_point_range cjk_symbols[] {{0x3000, 0x303F}, {0xFF00, 0xFFEF}};
+constexpr Code_point_range kana[] {{0x3040, 0x30FF}, {0x31F0, 0x31FF}};
+constexpr Code_point_range hangul_jamo[] {{0x1100, 0x11FF}, {0x3130, 0x318F}};
+constexpr Code_point_range hangul[] {{0xAC00, 0xD7A3}};
+constexpr Code_point_range cjk_unified[] {{0x4E00, 0x9FFF}};
+constexpr Code_point_range cjk_extension_a[] {{0x3400, 0x4DBF}};
+
+struct Range_preset {
+    std::string_view name;
+    std::span<const Code_point_range> ranges;
+};
+
+constexpr Range_preset presets[] {
+    {"ascii", ascii},
+    {"latin-1", latin_1},
+    {"latin-extended", latin_extended},
+    {"greek", greek},
+    {"cyrillic", cyrillic},
+    {"hebrew", hebrew},
+    {"arabic", arabic},
+    {"thai", thai},
+    {"punctuation", punctuation},
+    {"cjk-symbols", cjk_symbols},
+    {"kana", kana},
+    {"hangul-jamo", hangul_jamo},
+    {"hangul", hangul},
+    {"cjk-unified", cjk_unified},
+    {"cjk-extension-a", cjk_extension_a}
+};
+
+// an optional "U+" followed by 1 to 6 hexadecimal digits, up to U+10FFFF
+bool parse_code_point(std::string_view& str, char32_t& code_point) noexcept
+{
+    if(str.starts_with("U+") or str.starts_with("u+")) str.remove_prefix(2);
+    std::size_t digits = 0;
+    code_point = 0;
+    for(; digits < str.size() and digits < 7; ++digits) {
+        const char c = str[digits];
+        uint32 value = 0;
+        if(c >= '0' and c <= '9') value = c - '0';
+        else if(c >= 'A' and c <= 'F') value = c - 'A' + 10;
+        else if(c >= 'a' and c <= 'f') value = c - 'a' + 10;
+        else break;
+        code_point = code_point * 16 + value;
+    }
+    str.remove_prefix(digits);
+    return digits != 0 and digits <= 6 and code_point < Char_file::code_point_count;
+}
+
+} // namespace
+
+Char_file::~Char_file()
+{
+    close();
+}
+
+bool Char_file::open(const std::filesystem::path& path)
+{
+    close();
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    m_file = file;
+    LARGE_INTEGER size;
+    if(not GetFileSizeEx(file, &size)) return false;
+    m_size = static_cast<std::size_t>(size.QuadPart);
+    if(m_size == 0) return true; // empty files can't be mapped
+    m_mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(not m_mapping) return false;
+    m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    return m_data != nullptr;
+#endif // _WIN32
+
+#ifdef __linux__
+    m_file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(m_file == -1) return false;
+    struct stat file_status;
+    if(fstat(m_file, &file_status) == -1) return false;
+    m_size = static_cast<std::size_t>(file_status.st_size);
+    if(m_size == 0) return true; // empty files can't be mapped
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+    if(data == MAP_FAILED) return false;
+    madvise(data, m_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char*>(data);
+    return true;
+#endif // __linux__
+}
+
+void Char_file::close() noexcept
+{
+#ifdef _WIN32
+    if(m_data) UnmapViewOfFile(m_data);
+    if(m_mapping) CloseHandle(m_mapping);
+    if(m_file) CloseHandle(m_file);
+    m_mapping = m_file = nullptr;
+#endif // _WIN32
+
+#ifdef __linux__
+    if(m_data) munmap(const_cast<char*>(m_data), m_size);
+    if(m_file != -1) ::close(m_file);
+    m_file = -1;
+#endif // __linux__
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool Char_file::parse()
+{
+    m_characters.clear();
+    m_code_point_set.assign(code_point_count / 64, 0);
+    m_invalid_line = 0;
+
+    int32 line_number = 1;
+    int32 char_number = 1;
+    bool empty_line = true;
+    auto add = [&](const char32_t code_point) {
+        uint64& word = m_code_point_set[code_point / 64];
+        const uint64 bit = uint64 {1} << (code_point % 64);
+        if(word & bit) return;
+        word |= bit;
+        m_characters.push_back({code_point, line_number, char_number++});
+    };
+
+    const uint8* p = reinterpret_cast<const uint8*>(m_data);
+    const uint8* const end = p + m_size;
+    while(p < end) {
+        // the common case: 8 ASCII characters that don't end the line
+        if(end - p >= 8) {
+            uint64 word;
+            std::memcpy(&word, p, sizeof(word));
+            if((word & high_bits) == 0 and not has_byte(word, '\n') and not has_byte(word, '\r')) {
+                for(int i = 0; i < 8; ++i) add(p[i]);
+                p += 8;
+                empty_line = false;
+                continue;
+            }
+        }
+
+        if(*p == '\n') {
+            if(not empty_line) ++line_number;
+            empty_line = true;
+            char_number = 1;
+            ++p;
+            continue;
+        }
+        if(*p == '\r' and end - p >= 2 and p[1] == '\n') {
+            ++p;
+            continue;
+        }
+        empty_line = false;
+        if(*p < 0x80) {
+            add(*p++);
+            continue;
+        }
+        char32_t code_point = 0;
+        const int length = decode(p, end, code_point);
+        if(length == 0) {
+            m_invalid_line = line_number;
+            return false;
+        }
+        add(code_point);
+        p += length;
+    }
+    return true;
+}
+
+bool Char_file::add_ranges(std::string_view ranges)
+{
+    if(m_code_point_set.empty()) m_code_point_set.assign(code_point_count / 64, 0);
+    m_invalid_range = {};
+
+    while(true) {
+        const std::size_t comma = ranges.find(',');
+        const std::string_view item = ranges.substr(0, comma);
+        auto preset = std::find_if(std::begin(presets), std::end(presets), [&](const Range_preset& p) { return p.name == item; });
+        if(preset != std::end(presets)) {
+            for(const Code_point_range& range : preset->ranges) add_range(range.first, range.last);
+        }
+        else {
+            std::string_view str = item;
+            char32_t first = 0;
+            bool valid = parse_code_point(str, first);
+            char32_t last = first;
+            if(valid and str.starts_with('-')) {
+                str.remove_prefix(1);
+                valid = parse_code_point(str, last);
+            }
+            if(not valid or not str.empty() or first > last) {
+                m_invalid_range = item;
+                return false;
+            }
+            add_range(first, last);
+        }
+        if(comma == std::string_view::npos) break;
+        ranges.remove_prefix(comma + 1);
+    }
+    return true;
+}
+
+// the new code points of the range are found a whole word of the bitset at a time
+void Char_file::add_range(const char32_t first, const char32_t last)
+{
+    for(std::size_t w = first / 64; w <= last / 64; ++w) {
+        uint64 mask = ~uint64 {0};
+        if(w == first / 64) mask &= ~uint64 {0} << (first % 64);
+        if(w == last / 64 and last % 64 != 63) mask &= (uint64 {1} << (last % 64 + 1)) - 1;
+        for(uint64 bits = mask & ~m_code_point_set[w]; bits != 0; bits &= bits - 1) {
+            m_characters.push_back({static_cast<char32_t>(w * 64 + std::countr_zero(bits)), 0, 0});
+        }
+        m_code_point_set[w] |= mask;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <filesystem>
+#include <string_view>
+#include <vector>
+
+#include "mystdint.hpp"
+
+struct Char_file_entry {
+    char32_t code_point = 0;
+    int32 line_number = 0; // empty lines are not counted, 0 for the characters added by -ranges
+    int32 char_number = 0; // position among the characters that first appear in the line
+};
+
+/*
+Characters file (-char-file) reader. The file is memory mapped and parsed in a single pass:
+runs of 8 ASCII bytes without line breaks are detected with one 64-bit test and the rest of
+the bytes go through a table-free UTF-8 decoder that rejects what utf8::is_valid rejects
+(overlong forms, surrogates and code points above U+10FFFF). Each code point is recorded
+once, in order of first appearance, and also kept in a bitset for constant time lookups.
+Both "\n" and "\r\n" end a line.
+
+The characters of -ranges are added to the same set, see add_ranges().
+*/
+class Char_file {
+public:
+    static constexpr std::size_t code_point_count = 0x110000;
+
+    Char_file() noexcept {};
+    ~Char_file();
+    Char_file(const Char_file&) = delete;
+    Char_file& operator=(const Char_file&) = delete;
+
+    bool open(const std::filesystem::path& path);
+    std::string_view contents() const noexcept { return {m_data, m_size}; }
+
+    // returns false on invalid UTF-8, invalid_line() then tells where it was found
+    bool parse();
+    int32 invalid_line() const noexcept { return m_invalid_line; }
+
+    /* adds a comma separated list of code point ranges (U+3040-30FF), single code points (U+20AC)
+    * and preset names (kana), after the characters of the file and in code point order;
+    * returns false if an item is malformed, invalid_range() then tells which one
+    */
+    bool add_ranges(std::string_view ranges);
+    std::string_view invalid_range() const noexcept { return m_invalid_range; }
+
+    // the unique characters, in order of first appearance (what -as-given needs)
+    const std::vector<Char_file_entry>& characters() const noexcept { return m_characters; }
+    // one bit per code point, code_point_count / 64 words
+    const std::vector<uint64>& code_point_set() const noexcept { return m_code_point_set; }
+    bool contains(const char32_t code_point) const noexcept
+    {
+        return code_point < code_point_count and (m_code_point_set[code_point / 64] >> (code_point % 64)) & 1;
+    }
+private:
+    void close() noexcept;
+    void add_range(const char32_t first, const char32_t last);
+
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr; // HANDLE
+    void* m_mapping = nullptr; // HANDLE
+#endif // _WIN32
+#ifdef __linux__
+    int m_file = -1;
+#endif // __linux__
+    std::vector<Char_file_entry> m_characters;
+    std::vector<uint64> m_code_point_set;
+    int32 m_invalid_line = 0;
+    std::string_view m_invalid_range;
+};
@@ -0,0 +1,214 @@
+#include "coverage.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include "mystdint.hpp"
+
+#include "charfile.hpp"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/* Report format:
+fonts:<number of fonts>
+char-files:<number of characters files>
+and then, for each font in the order of the list:
+font:<font file>
+followed by one line per characters file, in the order of the list:
+<number of missing characters>:<missing code points in decimal, comma separated>:<characters file>
+*/
+
+namespace {
+
+constexpr std::size_t code_point_count = Char_file::code_point_count;
+constexpr std::size_t word_count = code_point_count / 64;
+
+// one bit per Unicode code point
+using Code_point_set = std::vector<uint64>;
+
+void insert(Code_point_set& set, const char32_t code_point) noexcept
+{
+    if(code_point < code_point_count) set[code_point / 64] |= uint64 {1} << (code_point % 64);
+}
+
+bool read_path_list(const std::filesystem::path& exe_dir, const std::string& list, std::vector<std::string>& paths)
+{
+    std::filesystem::path list_path {exe_dir};
+    list_path.append(list);
+    std::ifstream list_file {list_path};
+    if(not list_file) {
+        std::cout << "Error: Couldn't open the list " << list << ".\n";
+        return false;
+    }
+    std::string line;
+    while(std::getline(list_file, line)) {
+        if(not line.empty() and line.back() == '\r') line.pop_back();
+        if(not line.empty()) paths.push_back(line);
+    }
+    if(not list_file.eof()) {
+        std::cout << "Internal error: An error ocurred while reading the list " << list << ".\n";
+        return false;
+    }
+    if(paths.empty()) {
+        std::cout << "Error: The list " << list << " is empty.\n";
+        return false;
+    }
+    return true;
+}
+
+bool read_char_file(const std::filesystem::path& exe_dir, const std::string& char_file, Code_point_set& set)
+{
+    std::filesystem::path char_file_path {exe_dir};
+    char_file_path.append(char_file);
+    Char_file file;
+    if(not file.open(char_file_path)) {
+        std::cout << "Error: Couldn't open the characters file " << char_file << ".\n";
+        return false;
+    }
+    if(not file.parse()) {
+        std::cout << "Error: Invalid UTF-8 found in the characters file " << char_file << " at line #" << file.invalid_line() << ".\n";
+        return false;
+    }
+    set = file.code_point_set();
+    return true;
+}
+
+// the report lines of a single font, or the reason it couldn't be checked
+struct Font_coverage {
+    std::string report;
+    std::string error;
+};
+
+void check_font(FT_Library library, const std::filesystem::path& font_path, const std::vector<Code_point_set>& char_sets,
+                const std::vector<std::string>& char_files, std::vector<uint8>& font_bytes, Code_point_set& font_set, Font_coverage& coverage)
+{
+    std::ifstream ifs {font_path, std::ios_base::binary | std::ios_base::ate};
+    if(not ifs) {
+        coverage.error = "Couldn't open the font file";
+        return;
+    }
+    font_bytes.resize(ifs.tellg());
+    ifs.seekg(0, std::ios_base::beg);
+    ifs.read(reinterpret_cast<char*>(font_bytes.data()), font_bytes.size());
+    if(ifs.fail()) {
+        coverage.error = "Failed to read the font file";
+        return;
+    }
+
+    FT_Face face = nullptr;
+    if(FT_New_Memory_Face(library, font_bytes.data(), static_cast<FT_Long>(font_bytes.size()), 0, &face)) {
+        coverage.error = "FreeType couldn't load the font file";
+        return;
+    }
+    if(FT_Select_Charmap(face, FT_ENCODING_UNICODE)) {
+        FT_Done_Face(face);
+        coverage.error = "The font file doesn't contain a Unicode character map";
+        return;
+    }
+    font_set.assign(word_count, 0);
+    FT_UInt glyph_index = 0;
+    for(FT_ULong charcode = FT_Get_First_Char(face, &glyph_index); glyph_index != 0; charcode = FT_Get_Next_Char(face, charcode, &glyph_index)) {
+        insert(font_set, static_cast<char32_t>(charcode));
+    }
+    FT_Done_Face(face);
+
+    for(std::size_t c = 0; c < char_sets.size(); ++c) {
+        const Code_point_set& char_set = char_sets[c];
+        std::string missing;
+        int32 missing_count = 0;
+        for(std::size_t w = 0; w < word_count; ++w) {
+            for(uint64 bits = char_set[w] & ~font_set[w]; bits != 0; bits &= bits - 1) {
+                if(missing_count++ != 0) missing.append(1, ',');
+                missing.append(std::to_string(w * 64 + std::countr_zero(bits)));
+            }
+        }
+        coverage.report.append(std::to_string(missing_count)).append(1, ':').append(missing).append(1, ':');
+        coverage.report.append(char_files[c]).append(1, '\n');
+    }
+}
+
+} // namespace
+
+int run_coverage_report(const std::filesystem::path& exe_dir, const std::string& font_list, const std::string& char_file_list)
+{
+    std::vector<std::string> font_files;
+    std::vector<std::string> char_files;
+    if(not read_path_list(exe_dir, font_list, font_files)) return EXIT_FAILURE;
+    if(not read_path_list(exe_dir, char_file_list, char_files)) return EXIT_FAILURE;
+
+    std::vector<Code_point_set> char_sets(char_files.size());
+    for(std::size_t i = 0; i < char_files.size(); ++i) {
+        if(not read_char_file(exe_dir, char_files[i], char_sets[i])) return EXIT_FAILURE;
+    }
+
+    /* every thread takes the next unchecked font until there are none left */
+
+    std::vector<Font_coverage> results(font_files.size());
+    std::atomic<std::size_t> next_font {0};
+    std::atomic<bool> init_failed {false};
+    auto work = [&] {
+        FT_Library library = nullptr;
+        if(FT_Init_FreeType(&library)) {
+            init_failed = true;
+            return;
+        }
+        // kept between fonts to avoid allocating for each one
+        std::vector<uint8> font_bytes;
+        Code_point_set font_set;
+        for(std::size_t i = next_font++; i < font_files.size(); i = next_font++) {
+            std::filesystem::path font_path {exe_dir};
+            font_path.append(font_files[i]);
+            check_font(library, font_path, char_sets, char_files, font_bytes, font_set, results[i]);
+        }
+        FT_Done_FreeType(library);
+    };
+    const unsigned thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), font_files.size());
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < thread_count; ++i) threads.emplace_back(work);
+    work();
+    for(std::thread& t : threads) t.join();
+
+    if(init_failed) {
+        std::cout << "Internal error: FreeType initialisation failed.\n";
+        return EXIT_FAILURE;
+    }
+    for(std::size_t i = 0; i < font_files.size(); ++i) {
+        if(results[i].error.empty()) continue;
+        std::cout << "Error: " << results[i].error << " (" << font_files[i] << ").\n";
+        return EXIT_FAILURE;
+    }
+
+    /* the whole report is written at once */
+
+    std::string report;
+    report.append("fonts:").append(std::to_string(font_files.size())).append(1, '\n');
+    report.append("char-files:").append(std::to_string(char_files.size())).append(1, '\n');
+    for(std::size_t i = 0; i < font_files.size(); ++i) {
+        report.append("font:").append(font_files[i]).append(1, '\n');
+        report.append(results[i].report);
+    }
+
+    std::filesystem::path report_path {exe_dir};
+    report_path.append(std::u8string {u8"output/coverage.txt"});
+    std::ofstream report_file {report_path, std::ios_base::binary};
+    if(not report_file) {
+        std::cout << "Internal error: The coverage report couldn't be created.\n";
+        return EXIT_FAILURE;
+    }
+    report_file.write(report.data(), report.size());
+    report_file.close();
+    if(not report_file) {
+        std::cout << "Internal error: Writing the coverage report failed.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Finished the coverage check. Please check output/coverage.txt\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+/*
+Checks many font files against many characters files at once and writes a single report,
+output/coverage.txt, with the characters each font lacks for each characters file.
+Both lists are plain text files with one path per line; every path, including the lists,
+is relative to 'exe_dir', just like -font and -char-file.
+
+The cmap of each font is read once into a bitset of code points and every characters file is
+parsed once into another, so each font/characters file pair is a single pass of bitwise ANDs.
+The fonts are processed in parallel, each thread with its own FreeType library.
+*/
+int run_coverage_report(const std::filesystem::path& exe_dir, const std::string& font_list, const std::string& char_file_list);
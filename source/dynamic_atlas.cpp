@@ -0,0 +1,200 @@
+#include "dynamic_atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+Dynamic_atlas::Dynamic_atlas(FT_Face face, const int page_size, const int page_count, const bool sdf, const float defragment_threshold)
+    : m_face {face}, m_page_size {page_size}, m_render_mode {sdf ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL},
+    m_defragment_threshold {defragment_threshold}
+{
+    m_pages.reserve(page_count);
+    for(int i = 0; i < page_count; ++i) {
+        m_pages.push_back(Page {Bin {page_size, page_size}, std::vector<uint8>(static_cast<std::size_t>(page_size) * page_size), 0});
+    }
+}
+
+bool Dynamic_atlas::get(const char32_t code_point, Atlas_glyph& glyph)
+{
+    auto it = m_glyphs.find(code_point);
+    if(it != m_glyphs.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru_position);
+        glyph = it->second.glyph;
+        return true;
+    }
+
+    const FT_UInt glyph_index = FT_Get_Char_Index(m_face, code_point);
+    if(glyph_index == 0u) return false;
+    if(FT_Load_Glyph(m_face, glyph_index, FT_LOAD_DEFAULT)) return false;
+    if(FT_Render_Glyph(m_face->glyph, m_render_mode)) return false;
+
+    const FT_GlyphSlot slot = m_face->glyph;
+    Rect r;
+    r.code_point = code_point;
+    r.w = slot->bitmap.width;
+    r.h = slot->bitmap.rows;
+    if(r.w > m_page_size or r.h > m_page_size) return false;
+    // no FreeType calls happen while inserting, so the glyph slot's bitmap stays valid
+    if(not insert(r)) return false;
+    copy_pixels(r.bin, r, slot->bitmap.buffer, slot->bitmap.pitch);
+    mark_dirty(r);
+
+    Entry entry;
+    entry.glyph.rect = r;
+    entry.glyph.left_bearing = slot->bitmap_left;
+    entry.glyph.top_bearing = slot->bitmap_top;
+    entry.glyph.advance_x = slot->advance.x >> 6;
+    entry.glyph.advance_y = slot->advance.y >> 6;
+    m_lru.push_front(code_point);
+    entry.lru_position = m_lru.begin();
+    m_glyphs.emplace(code_point, entry);
+
+    glyph = entry.glyph;
+    return true;
+}
+
+void Dynamic_atlas::evict(const char32_t code_point)
+{
+    auto it = m_glyphs.find(code_point);
+    if(it == m_glyphs.end()) return;
+
+    const Rect& r = it->second.glyph.rect;
+    Page& page = m_pages[r.bin];
+    page.bin.release(r);
+    page.used_area -= r.area();
+    m_lru.erase(it->second.lru_position);
+    m_glyphs.erase(it);
+}
+
+std::vector<Rect> Dynamic_atlas::take_dirty_rects()
+{
+    std::vector<Rect> dirty_rects;
+    dirty_rects.swap(m_dirty_rects);
+    return dirty_rects;
+}
+
+std::vector<char32_t> Dynamic_atlas::take_evicted_glyphs()
+{
+    std::vector<char32_t> evicted_glyphs;
+    evicted_glyphs.swap(m_evicted_glyphs);
+    return evicted_glyphs;
+}
+
+std::vector<char32_t> Dynamic_atlas::take_moved_glyphs()
+{
+    std::vector<char32_t> moved_glyphs;
+    moved_glyphs.swap(m_moved_glyphs);
+    std::sort(moved_glyphs.begin(), moved_glyphs.end());
+    moved_glyphs.erase(std::unique(moved_glyphs.begin(), moved_glyphs.end()), moved_glyphs.end());
+    std::erase_if(moved_glyphs, [this](const char32_t code_point) { return not m_glyphs.contains(code_point); });
+    return moved_glyphs;
+}
+
+float Dynamic_atlas::fragmentation(const int page) const noexcept
+{
+    const Page& p = m_pages[page];
+    const int64 free_area = static_cast<int64>(m_page_size) * m_page_size - p.used_area;
+    if(free_area <= 0) return 0.0f;
+    return 1.0f - static_cast<float>(p.bin.largest_free_area()) / static_cast<float>(free_area);
+}
+
+bool Dynamic_atlas::insert(Rect& r)
+{
+    for(int i = 0; i < page_count(); ++i) {
+        if(m_pages[i].bin.insert(r)) {
+            r.bin = i;
+            m_pages[i].used_area += r.area();
+            return true;
+        }
+    }
+
+    /* the pages are full, make room by evicting the least recently used glyphs */
+    int page = 0;
+    while(evict_least_recently_used(page)) {
+        if(fragmentation(page) > m_defragment_threshold) defragment(page);
+        if(m_pages[page].bin.insert(r)) {
+            r.bin = page;
+            m_pages[page].used_area += r.area();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Dynamic_atlas::evict_least_recently_used(int& page)
+{
+    if(m_lru.empty()) return false;
+    const char32_t code_point = m_lru.back();
+    page = m_glyphs[code_point].glyph.rect.bin;
+    evict(code_point);
+    m_evicted_glyphs.push_back(code_point);
+    return true;
+}
+
+void Dynamic_atlas::defragment(const int page)
+{
+    Page& p = m_pages[page];
+    const std::vector<uint8> old_pixels {p.pixels};
+    std::vector<Entry*> entries;
+    for(auto& [code_point, entry] : m_glyphs) {
+        if(entry.glyph.rect.bin == page) entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry* lhs, const Entry* rhs) { return lhs->glyph.rect.area() > rhs->glyph.rect.area(); });
+
+    p.bin.reset();
+    p.used_area = 0;
+    std::memset(p.pixels.data(), 0, p.pixels.size());
+    std::vector<Entry*> left_out; // a different packing order can leave glyphs out
+    for(Entry* entry : entries) {
+        const Rect old_rect = entry->glyph.rect;
+        Rect r = old_rect;
+        if(not p.bin.insert(r)) {
+            left_out.push_back(entry);
+            continue;
+        }
+        copy_pixels(page, r, old_pixels.data() + static_cast<std::size_t>(old_rect.y) * m_page_size + old_rect.x, m_page_size);
+        p.used_area += r.area();
+        if(r.x != old_rect.x or r.y != old_rect.y) m_moved_glyphs.push_back(r.code_point);
+        entry->glyph.rect = r;
+    }
+    for(Entry* entry : left_out) {
+        const Rect old_rect = entry->glyph.rect;
+        Rect r = old_rect;
+        int other = 0;
+        while(other < page_count() and (other == page or not m_pages[other].bin.insert(r))) ++other;
+        if(other == page_count()) { // evicted, like the least recently used glyphs
+            m_evicted_glyphs.push_back(r.code_point);
+            m_lru.erase(entry->lru_position);
+            m_glyphs.erase(r.code_point);
+            continue;
+        }
+        r.bin = other;
+        copy_pixels(other, r, old_pixels.data() + static_cast<std::size_t>(old_rect.y) * m_page_size + old_rect.x, m_page_size);
+        m_pages[other].used_area += r.area();
+        m_moved_glyphs.push_back(r.code_point);
+        entry->glyph.rect = r;
+        mark_dirty(r);
+    }
+
+    Rect whole_page;
+    whole_page.w = m_page_size;
+    whole_page.h = m_page_size;
+    whole_page.bin = page;
+    mark_dirty(whole_page);
+}
+
+void Dynamic_atlas::copy_pixels(const int page, const Rect& where, const uint8* source, const int source_pitch) noexcept
+{
+    uint8* destination = m_pages[page].pixels.data() + static_cast<std::size_t>(where.y) * m_page_size + where.x;
+    for(int row = 0; row < where.h; ++row) {
+        std::memcpy(destination, source, where.w);
+        destination += m_page_size;
+        source += source_pitch;
+    }
+}
+
+void Dynamic_atlas::mark_dirty(const Rect& r)
+{
+    if(r.area() == 0) return;
+    m_dirty_rects.push_back(r);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "mystdint.hpp"
+#include "maxrects.hpp"
+
+struct Atlas_glyph {
+    Rect rect; // 'bin' is the page that contains the glyph
+    int left_bearing = 0;
+    int top_bearing = 0;
+    int advance_x = 0;
+    int advance_y = 0;
+};
+
+/*
+Runtime glyph atlas: glyphs are rendered and packed the first time they are requested. When
+the pages are full, the least recently used glyphs are evicted and their space is given back
+to the page's Bin. A page whose free space becomes too fragmented is packed again from scratch,
+which moves its glyphs; a glyph that doesn't fit back goes to another page if one has room.
+So an Atlas_glyph returned by get() is only valid until the next get(): the glyphs listed by
+take_moved_glyphs() must be fetched again, and those listed by take_evicted_glyphs() are gone.
+
+The face is borrowed: the caller owns it, selects the charmap and sets the pixel size.
+*/
+class Dynamic_atlas {
+public:
+    Dynamic_atlas(FT_Face face, const int page_size, const int page_count, const bool sdf, const float defragment_threshold = 0.5f);
+
+    bool get(const char32_t code_point, Atlas_glyph& glyph); // false if the font lacks it or it doesn't fit in a page
+    void evict(const char32_t code_point);
+
+    int page_size() const noexcept { return m_page_size; }
+    int page_count() const noexcept { return static_cast<int>(m_pages.size()); }
+    const uint8* page_pixels(const int page) const noexcept { return m_pages[page].pixels.data(); }
+    // regions of the pages that changed since the last call, only those need to be uploaded
+    std::vector<Rect> take_dirty_rects();
+    // glyphs that left the atlas since the last call to make room for others: the least recently used
+    // ones, and those that fit in no page anymore after their page was packed again
+    std::vector<char32_t> take_evicted_glyphs();
+    // glyphs still in the atlas whose rectangle changed since the last call, get() returns their new one
+    std::vector<char32_t> take_moved_glyphs();
+    float fragmentation(const int page) const noexcept; // 0 when all the free space is a single rectangle
+private:
+    struct Page {
+        Bin bin;
+        std::vector<uint8> pixels;
+        int64 used_area = 0;
+    };
+    struct Entry {
+        Atlas_glyph glyph;
+        std::list<char32_t>::iterator lru_position;
+    };
+
+    bool insert(Rect& r);
+    bool evict_least_recently_used(int& page);
+    void defragment(const int page);
+    void copy_pixels(const int page, const Rect& where, const uint8* source, const int source_pitch) noexcept;
+    void mark_dirty(const Rect& r);
+
+    FT_Face m_face;
+    const int m_page_size;
+    const FT_Render_Mode m_render_mode;
+    const float m_defragment_threshold;
+    std::vector<Page> m_pages;
+    std::list<char32_t> m_lru; // front is the most recently used glyph
+    std::unordered_map<char32_t, Entry> m_glyphs;
+    std::vector<Rect> m_dirty_rects;
+    std::vector<char32_t> m_evicted_glyphs;
+    std::vector<char32_t> m_moved_glyphs; // may also hold glyphs evicted since they moved
+};
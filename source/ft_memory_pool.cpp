@@ -0,0 +1,121 @@
+#include "ft_memory_pool.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include "mystdint.hpp"
+
+#include "alloc_stats.hpp"
+
+namespace {
+
+// every block starts with its size class and its capacity, the rest of the header keeps the block aligned like malloc's
+constexpr std::size_t header_size = alignof(std::max_align_t);
+static_assert(header_size >= 2 * sizeof(std::size_t));
+constexpr std::size_t smallest_class = 16;
+
+int size_class(const std::size_t size) noexcept
+{
+    if(size <= smallest_class) return 0;
+    return std::bit_width(size - 1) - std::bit_width(smallest_class - 1);
+}
+
+int size_class_of(void* block) noexcept
+{
+    int c;
+    std::memcpy(&c, static_cast<uint8*>(block) - header_size, sizeof(c));
+    return c;
+}
+
+} // namespace
+
+Ft_memory_pool::Ft_memory_pool() noexcept
+    : m_memory {this, alloc, free, realloc}
+{
+}
+
+Ft_memory_pool::~Ft_memory_pool()
+{
+    for(void* block : m_free_lists) {
+        while(block) {
+            void* next = *static_cast<void**>(block);
+            std::free(static_cast<uint8*>(block) - header_size);
+            block = next;
+        }
+    }
+}
+
+void* Ft_memory_pool::alloc(FT_Memory memory, long size)
+{
+    return static_cast<Ft_memory_pool*>(memory->user)->allocate(static_cast<std::size_t>(size));
+}
+
+void Ft_memory_pool::free(FT_Memory memory, void* block)
+{
+    static_cast<Ft_memory_pool*>(memory->user)->release(block);
+}
+
+// FreeType only reallocates blocks it allocated, with a non-zero size
+void* Ft_memory_pool::realloc(FT_Memory memory, long current_size, long new_size, void* block)
+{
+    Ft_memory_pool& pool = *static_cast<Ft_memory_pool*>(memory->user);
+    const int c = size_class_of(block);
+    if(c < class_count and static_cast<std::size_t>(new_size) <= smallest_class << c) return block;
+    if(c == class_count and size_class(new_size) >= class_count) { // both are too large for the pool
+        count_freetype_allocation(new_size);
+        uint8* base = static_cast<uint8*>(std::realloc(static_cast<uint8*>(block) - header_size, header_size + new_size));
+        if(not base) return nullptr;
+        std::size_t capacity;
+        std::memcpy(&capacity, base + sizeof(std::size_t), sizeof(capacity));
+        pool.resize(new_size, capacity);
+        capacity = static_cast<std::size_t>(new_size);
+        std::memcpy(base + sizeof(std::size_t), &capacity, sizeof(capacity));
+        return base + header_size;
+    }
+    void* new_block = pool.allocate(new_size);
+    if(not new_block) return nullptr;
+    std::memcpy(new_block, block, std::min(current_size, new_size));
+    pool.release(block);
+    return new_block;
+}
+
+void* Ft_memory_pool::allocate(const std::size_t size)
+{
+    const int c = std::min(size_class(size), class_count);
+    if(c < class_count and m_free_lists[c]) {
+        void* block = m_free_lists[c];
+        m_free_lists[c] = *static_cast<void**>(block);
+        return block;
+    }
+    const std::size_t capacity = c < class_count ? smallest_class << c : size;
+    count_freetype_allocation(capacity);
+    uint8* base = static_cast<uint8*>(std::malloc(header_size + capacity));
+    if(not base) return nullptr;
+    std::memcpy(base, &c, sizeof(c));
+    std::memcpy(base + sizeof(std::size_t), &capacity, sizeof(capacity));
+    resize(header_size + capacity, 0);
+    return base + header_size;
+}
+
+void Ft_memory_pool::release(void* block) noexcept
+{
+    if(not block) return;
+    const int c = size_class_of(block);
+    if(c == class_count) {
+        uint8* base = static_cast<uint8*>(block) - header_size;
+        std::size_t capacity;
+        std::memcpy(&capacity, base + sizeof(std::size_t), sizeof(capacity));
+        resize(0, header_size + capacity);
+        std::free(base);
+        return;
+    }
+    *static_cast<void**>(block) = m_free_lists[c];
+    m_free_lists[c] = block;
+}
+
+void Ft_memory_pool::resize(const std::size_t added, const std::size_t removed) noexcept
+{
+    m_size = m_size + added - removed;
+    m_peak_size = std::max(m_peak_size, m_size);
+}
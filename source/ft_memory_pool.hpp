@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_SYSTEM_H
+
+/*
+FreeType allocator for the library that loads and renders the glyphs. Loading and rendering a
+glyph allocates and frees the same few blocks for every glyph (the outline, the bitmap and the
+scratch buffers of the rasteriser and of the SDF renderers), so freed blocks are kept in free
+lists by power of two size class and handed out again: after the first glyphs, the hot path
+no longer reaches malloc. Blocks above the largest class go straight to malloc and free.
+
+The pool is not reset between glyphs, that would be unsafe: the faces, their tables and the
+glyph slot's loader stay allocated across glyphs, and the rendered bitmap belongs to the slot
+until the next glyph is loaded (place_pixel_data reads it until then). Blocks are only reused
+once FreeType frees them.
+
+A pool isn't thread-safe, the library given its memory() must only be used by one thread at a
+time, and the library must be done before the pool is destroyed.
+*/
+class Ft_memory_pool {
+public:
+    Ft_memory_pool() noexcept;
+    ~Ft_memory_pool();
+    Ft_memory_pool(const Ft_memory_pool&) = delete;
+    Ft_memory_pool& operator=(const Ft_memory_pool&) = delete;
+
+    FT_Memory memory() noexcept { return &m_memory; }
+    // the most memory the pool held from malloc at once, its free lists included (-max-memory)
+    std::size_t peak_size() const noexcept { return m_peak_size; }
+private:
+    static constexpr int class_count = 17; // 16 bytes to 1 MiB
+
+    static void* alloc(FT_Memory memory, long size);
+    static void free(FT_Memory memory, void* block);
+    static void* realloc(FT_Memory memory, long current_size, long new_size, void* block);
+
+    void* allocate(const std::size_t size);
+    void release(void* block) noexcept;
+    void resize(const std::size_t added, const std::size_t removed) noexcept;
+
+    FT_MemoryRec_ m_memory;
+    void* m_free_lists[class_count] {}; // each free block starts with a pointer to the next one
+    std::size_t m_size = 0;
+    std::size_t m_peak_size = 0;
+};
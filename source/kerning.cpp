@@ -0,0 +1,63 @@
+#include "kerning.hpp"
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+bool compute_kerning(const std::vector<std::vector<uint8>>& font_files, const int font_size, const std::vector<Kerning_glyph>& glyphs,
+                     std::vector<Kerning_pair>& pairs)
+{
+    pairs.clear();
+    if(glyphs.empty()) return true;
+
+    // the pairs of each left glyph, concatenated in order at the end so no sorting is needed
+    std::vector<std::vector<Kerning_pair>> rows(glyphs.size());
+    std::atomic<std::size_t> next_row {0};
+    std::atomic<bool> failed {false};
+    auto work = [&] {
+        FT_Library library = nullptr;
+        if(FT_Init_FreeType(&library)) {
+            failed = true;
+            return;
+        }
+        // fonts without a 'kern' table keep a null face and are skipped
+        std::vector<FT_Face> faces(font_files.size(), nullptr);
+        for(std::size_t i = 0; i < font_files.size(); ++i) {
+            FT_Face face = nullptr;
+            if(FT_New_Memory_Face(library, font_files[i].data(), static_cast<FT_Long>(font_files[i].size()), 0, &face) or
+               FT_Set_Pixel_Sizes(face, 0, font_size)) {
+                failed = true;
+                FT_Done_FreeType(library);
+                return;
+            }
+            if(FT_HAS_KERNING(face)) faces[i] = face;
+            else FT_Done_Face(face);
+        }
+
+        for(std::size_t i = next_row++; i < glyphs.size() and not failed; i = next_row++) {
+            const Kerning_glyph& left = glyphs[i];
+            FT_Face face = faces[left.face];
+            if(not face) continue;
+            for(const Kerning_glyph& right : glyphs) {
+                if(right.face != left.face) continue;
+                FT_Vector kerning;
+                if(FT_Get_Kerning(face, left.glyph_index, right.glyph_index, FT_KERNING_DEFAULT, &kerning)) continue;
+                const int x = static_cast<int>(kerning.x >> 6); // FT_KERNING_DEFAULT is already grid-fitted
+                if(x != 0) rows[i].push_back({left.code_point, right.code_point, x});
+            }
+        }
+        FT_Done_FreeType(library); // also frees the faces
+    };
+    const unsigned thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), glyphs.size());
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < thread_count; ++i) threads.emplace_back(work);
+    work();
+    for(std::thread& t : threads) t.join();
+    if(failed) return false;
+
+    std::size_t pair_count = 0;
+    for(const std::vector<Kerning_pair>& row : rows) pair_count += row.size();
+    pairs.reserve(pair_count);
+    for(const std::vector<Kerning_pair>& row : rows) pairs.insert(pairs.end(), row.begin(), row.end());
+    return true;
+}
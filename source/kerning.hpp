@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "mystdint.hpp"
+
+struct Kerning_glyph {
+    char32_t code_point = 0;
+    FT_UInt glyph_index = 0;
+    int face = 0; // index in 'font_files'
+};
+
+struct Kerning_pair {
+    char32_t left = 0;
+    char32_t right = 0;
+    int x = 0; // in pixels, added to the advance of 'left'
+};
+
+/*
+Horizontal kerning of every pair of 'glyphs' that come from the same font, read from the legacy
+'kern' table with FT_Get_Kerning at 'font_size' pixels. Only the non-zero pairs are returned,
+sorted by left and then right code point when 'glyphs' is sorted by code point.
+
+The left glyphs are spread across threads; each thread opens its own FreeType library and faces
+from the in-memory font files, since a face can't be used by two threads at once.
+Returns false if FreeType fails to initialise or to open a face.
+*/
+bool compute_kerning(const std::vector<std::vector<uint8>>& font_files, const int font_size, const std::vector<Kerning_glyph>& glyphs,
+                     std::vector<Kerning_pair>& pairs);
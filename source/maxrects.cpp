@@ -1,13 +1,12 @@
 #include "maxrects.hpp"
 
-#include <limits>
 #include <algorithm>
 #include <stdexcept>
 #include <string>
 #include "mystdint.hpp"
 
-Bin::Bin(const int width, const int height, const bool multiple_bins) noexcept
-    : m_width {width}, m_height {height}, m_multiple_bins {multiple_bins}
+Bin_base::Bin_base(const int width, const int height, const bool allow_rotation) noexcept
+    : m_width {width}, m_height {height}, m_allow_rotation {allow_rotation}
 {
     // initially, the entire bin is free
     Rect rect;
@@ -15,77 +14,133 @@ Bin::Bin(const int width, const int height, const bool multiple_bins) noexcept
     rect.h = height;
 
     m_free_rectangles.push_back(rect);
+    m_stats.pages.emplace_back();
 }
 
-void Bin::layout_bulk(std::vector<Rect>& container)
+Bin_stats& Bin_stats::operator+=(const Bin_stats& other)
 {
-    int bin_instance = 0;
-    for(Rect& r : container) {
-        /* search the best free rectangle */
-        auto it = find_best_free_rectangle(r);
-        if(it == m_free_rectangles.cend()) { // no more rectangles fit in the bin
-            if(not m_multiple_bins) return;
-            reset();
-            ++bin_instance;
-            it = find_best_free_rectangle(r);
-            if(it == m_free_rectangles.cend()) {
-                std::string error_msg {"Error: The glyph "};
-                error_msg.append(std::to_string(static_cast<uint32>(r.code_point)));
-                error_msg.append(" (UTF-32 code point) didn't fit in an empty bin. The -font-size is too large for the -image-size.");
-                throw std::runtime_error {error_msg};
-            }
+    pages.insert(pages.end(), other.pages.cbegin(), other.pages.cend());
+    searches += other.searches;
+    searched_free_rectangles += other.searched_free_rectangles;
+    peak_free_rectangles = std::max(peak_free_rectangles, other.peak_free_rectangles);
+    splits += other.splits;
+    containment_tests += other.containment_tests;
+    search_time += other.search_time;
+    split_time += other.split_time;
+    prune_time += other.prune_time;
+    return *this;
+}
+
+void Bin_base::occupy(const Rect& used) noexcept
+{
+    m_stats.pages.back().used_area += used.area();
+    ++m_stats.pages.back().rectangles;
+
+    /* compute new free rectangles */
+    const auto split_start = m_timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point {};
+    for(auto iter = m_free_rectangles.cbegin(); iter != m_free_rectangles.cend();) {
+        if(overlaps(*iter, used)) {
+            compute_new_free_rectangles(*iter, used);
+            iter = m_free_rectangles.erase(iter);
+            ++m_stats.splits;
         }
-        r.x = it->x;
-        r.y = it->y;
-        r.bin = bin_instance;
-
-        /* compute new free rectangles */
-        for(auto iter = m_free_rectangles.cbegin(); iter != m_free_rectangles.cend();) {
-            if(overlaps(*iter, r)) {
-                compute_new_free_rectangles(*iter, r);
-                iter = m_free_rectangles.erase(iter);
+        else { ++iter; }
+    }
+    const auto prune_start = m_timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point {};
+    if(m_timed) m_stats.split_time += prune_start - split_start;
+    /* validate the new free rectangles against themselves */
+    for(auto iter1 = m_new_free_rectangles.cbegin(); iter1 != m_new_free_rectangles.cend(); ++iter1) {
+        for(auto iter2 = m_new_free_rectangles.cbegin(); iter2 != m_new_free_rectangles.cend();) {
+            if(iter1 == iter2) {
+                ++iter2;
+                continue;
+            }
+
+            if(inside(*iter1, *iter2)) {
+                iter2 = m_new_free_rectangles.erase(iter2);
+                continue;
             }
-            else { ++iter; }
+            ++iter2;
         }
-        /* validate the new free rectangles against themselves */
-        for(auto iter1 = m_new_free_rectangles.cbegin(); iter1 != m_new_free_rectangles.cend(); ++iter1) {
-            for(auto iter2 = m_new_free_rectangles.cbegin(); iter2 != m_new_free_rectangles.cend();) {
-                if(iter1 == iter2) {
-                    ++iter2;
-                    continue;
-                }
-
-                if(inside(*iter1, *iter2)) {
-                    iter2 = m_new_free_rectangles.erase(iter2);
-                    continue;
-                }
-                ++iter2;
+    }
+    /* validate the new free rectangles against the old free rectangles */
+    for(auto iter1 = m_free_rectangles.cbegin(); iter1 != m_free_rectangles.cend(); ++iter1) {
+        for(auto iter2 = m_new_free_rectangles.cbegin(); iter2 != m_new_free_rectangles.cend();) {
+            if(inside(*iter1, *iter2)) {
+                iter2 = m_new_free_rectangles.erase(iter2);
+                continue;
             }
+            ++iter2;
         }
-        /* validate the new free rectangles against the old free rectangles */
-        for(auto iter1 = m_free_rectangles.cbegin(); iter1 != m_free_rectangles.cend(); ++iter1) {
-            for(auto iter2 = m_new_free_rectangles.cbegin(); iter2 != m_new_free_rectangles.cend();) {
-                if(inside(*iter1, *iter2)) {
-                    iter2 = m_new_free_rectangles.erase(iter2);
-                    continue;
-                }
-                ++iter2;
+    }
+    /* the merging can finally be done */
+    m_free_rectangles.insert(m_free_rectangles.end(), m_new_free_rectangles.cbegin(), m_new_free_rectangles.cend());
+    m_new_free_rectangles.clear();
+    m_stats.peak_free_rectangles = std::max(m_stats.peak_free_rectangles, m_free_rectangles.size());
+    if(m_timed) m_stats.prune_time += std::chrono::steady_clock::now() - prune_start;
+}
+
+void Bin_base::release(const Rect& used)
+{
+    m_stats.pages.back().used_area -= used.area();
+    --m_stats.pages.back().rectangles;
+
+    Rect released;
+    released.x = used.x;
+    released.y = used.y;
+    released.w = used.w;
+    released.h = used.h;
+    if(released.area() == 0) return;
+
+    /* grow the released rectangle with the free rectangles that share a whole side with it */
+    bool merged = true;
+    while(merged) {
+        merged = false;
+        for(auto iter = m_free_rectangles.cbegin(); iter != m_free_rectangles.cend(); ++iter) {
+            const Rect& f = *iter;
+            if(f.y == released.y and f.h == released.h and (f.x + f.w == released.x or released.x + released.w == f.x)) {
+                released.x = std::min(released.x, f.x);
+                released.w += f.w;
+                merged = true;
+            }
+            else if(f.x == released.x and f.w == released.w and (f.y + f.h == released.y or released.y + released.h == f.y)) {
+                released.y = std::min(released.y, f.y);
+                released.h += f.h;
+                merged = true;
+            }
+            if(merged) {
+                m_free_rectangles.erase(iter);
+                break;
             }
         }
-        /* the merging can finally be done */
-        m_free_rectangles.insert(m_free_rectangles.end(), m_new_free_rectangles.cbegin(), m_new_free_rectangles.cend());
-        m_new_free_rectangles.clear();
-        ++m_processed_rectangles;
     }
+    /* drop the free rectangles that are now redundant */
+    for(auto iter = m_free_rectangles.cbegin(); iter != m_free_rectangles.cend();) {
+        if(inside(*iter, released)) return;
+        if(inside(released, *iter)) {
+            iter = m_free_rectangles.erase(iter);
+            continue;
+        }
+        ++iter;
+    }
+    m_free_rectangles.push_back(released);
 }
 
-int Bin::processed_rectangles() const noexcept
+int64 Bin_base::largest_free_area() const noexcept
+{
+    int64 largest = 0;
+    for(const Rect& r : m_free_rectangles) largest = std::max(largest, r.area());
+    return largest;
+}
+
+int Bin_base::processed_rectangles() const noexcept
 {
     return m_processed_rectangles;
 }
 
-void Bin::reset() noexcept
+void Bin_base::reset() noexcept
 {
+    m_stats.pages.back() = {};
     m_free_rectangles.clear();
     Rect r;
     r.w = m_width;
@@ -93,55 +148,39 @@ void Bin::reset() noexcept
     m_free_rectangles.push_back(r);
 }
 
-bool Bin::fits(const Rect& a, const Rect& b) noexcept
+void Bin_base::new_page() noexcept
+{
+    m_stats.pages.emplace_back();
+    reset();
+}
+
+void Bin_base::throw_too_large(const Rect& r)
+{
+    std::string error_msg {"Error: The glyph "};
+    error_msg.append(std::to_string(static_cast<uint32>(r.code_point)));
+    error_msg.append(" (UTF-32 code point) didn't fit in an empty bin. The -font-size is too large for the -image-size.");
+    throw std::runtime_error {error_msg};
+}
+
+bool Bin_base::fits(const Rect& a, const Rect& b) noexcept
 {
     return b.w <= a.w and b.h <= a.h;
 }
 
-bool Bin::overlaps(const Rect& a, const Rect& b) noexcept
+bool Bin_base::overlaps(const Rect& a, const Rect& b) noexcept
 {
     const bool x_overlap = b.x <= a.x + (a.w - 1) and b.x + (b.w - 1) >= a.x;
     const bool y_overlap = b.y <= a.y + (a.h - 1) and b.y + (b.h - 1) >= a.y;
     return x_overlap and y_overlap;
 }
 
-bool Bin::inside(const Rect& a, const Rect& b) noexcept
+bool Bin_base::inside(const Rect& a, const Rect& b) noexcept
 {
+    ++m_stats.containment_tests;
     return b.x >= a.x and b.x + b.w <= a.x + a.w and b.y >= a.y and b.y + b.h <= a.y + a.h;
 }
 
-std::list<Rect>::const_iterator Bin::find_best_free_rectangle(const Rect& outsider) noexcept
-{
-    // Best Area Fit score (lower is better)
-    int baf_score = std::numeric_limits<int>::max();
-    // Best Short Side Fit score (lower is better)
-    int bssf_score = std::numeric_limits<int>::max();
-
-    auto iter_result = m_free_rectangles.cend();
-    auto iter_end = m_free_rectangles.cend();
-    for(auto iter = m_free_rectangles.cbegin(); iter != iter_end; ++iter) {
-        const Rect& free_rect = *iter;
-        if(fits(free_rect, outsider)) {
-            int unused_area = free_rect.area() - outsider.area();
-
-            int unused_width = free_rect.w - outsider.w;
-            int unused_height = free_rect.h - outsider.h;
-            int most_used_dimension = std::min(unused_width, unused_height);
-
-            if(unused_area < baf_score) {
-                baf_score = unused_area;
-                iter_result = iter;
-            }
-            else if(unused_area == baf_score and most_used_dimension < bssf_score) {
-                bssf_score = most_used_dimension;
-                iter_result = iter;
-            }
-        }
-    }
-    return iter_result;
-}
-
-void Bin::compute_new_free_rectangles(const Rect& free_rect, const Rect& inserted_rect) noexcept
+void Bin_base::compute_new_free_rectangles(const Rect& free_rect, const Rect& inserted_rect) noexcept
 {
     // compute potential new free rectangles located above and below
     if(inserted_rect.x < free_rect.x + free_rect.w and inserted_rect.x + inserted_rect.w > free_rect.x) {
@@ -2,6 +2,14 @@
 
 #include <vector>
 #include <list>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <utility>
+#include <atomic>
+#include <thread>
+
+#include "mystdint.hpp"
 
 struct Rect {
     char32_t code_point = 0;
@@ -10,26 +18,147 @@ struct Rect {
     int w = 0; // width
     int h = 0; // height
     int bin = -1;
+    int variant = 0; // which subpixel offset the glyph was rendered at, see -subpixel
+    bool rotated = false; // placed turned 90 degrees clockwise, 'w' and 'h' are then swapped
+
+    int64 area() const noexcept { return static_cast<int64>(w) * h; } // 32768 * 32768 doesn't fit in an int
+};
 
-    int area() const noexcept { return w * h; }
+// how a Bin behaved, for tuning the packer (-packer-stats)
+struct Bin_stats {
+    struct Page {
+        int64 used_area = 0;
+        int rectangles = 0;
+    };
+    std::vector<Page> pages; // one per bin instance, in order
+    uint64 searches = 0; // calls to find_best_free_rectangle
+    uint64 searched_free_rectangles = 0; // free rectangles looked at by those calls
+    std::size_t peak_free_rectangles = 0;
+    uint64 splits = 0; // free rectangles split by a placed rectangle
+    uint64 containment_tests = 0; // mostly done while pruning the redundant free rectangles
+    // only measured once enable_timing() is called, reading the clock isn't free
+    std::chrono::steady_clock::duration search_time {};
+    std::chrono::steady_clock::duration split_time {};
+    std::chrono::steady_clock::duration prune_time {};
+
+    Bin_stats& operator+=(const Bin_stats& other);
 };
 
 /*
-This class implements the Maximal Rectangles (Best Area Fit variation) algorithm
-as described in Jukka Jylänki's document: https://github.com/juj/RectangleBinPack/blob/master/RectangleBinPack.pdf
+Scoring policies of the packer (-heuristic). A policy is created for each search and is given the
+free rectangles that can hold the rectangle, one after another, with the width and height the
+rectangle would have there ('turned' when tried turned 90 degrees). improves() returns true if
+that free rectangle is better than the best one so far, and then remembers it as the best.
 */
-class Bin {
+
+// Best Area Fit, ties broken by Best Short Side Fit, as in Jylänki's document (the default)
+class Best_area_fit {
 public:
-    Bin(const int width, const int height, const bool multiple_bins) noexcept;
+    bool improves(const Rect& free_rect, const int w, const int h, const bool turned) noexcept
+    {
+        const int64 unused_area = free_rect.area() - static_cast<int64>(w) * h;
+        const int short_side = std::min(free_rect.w - w, free_rect.h - h);
+        if(not turned) {
+            if(unused_area < m_area) {
+                m_area = unused_area;
+                m_result_short_side = short_side;
+                return true;
+            }
+            if(unused_area == m_area and short_side < m_short_side) {
+                m_short_side = short_side;
+                m_result_short_side = short_side;
+                return true;
+            }
+            return false;
+        }
+        // the same area is left either way, so the turned rectangle wins on a tighter short side
+        if(unused_area < m_area or (unused_area == m_area and short_side < m_result_short_side)) {
+            m_area = unused_area;
+            m_short_side = short_side;
+            m_result_short_side = short_side;
+            return true;
+        }
+        return false;
+    }
+private:
+    int64 m_area = std::numeric_limits<int64>::max();
+    int m_short_side = std::numeric_limits<int>::max(); // only updated on ties of the area
+    int m_result_short_side = std::numeric_limits<int>::max(); // the short side left by the best one
+};
 
-    void layout_bulk(std::vector<Rect>& container);
+// keeps the lowest (primary, secondary) score, the first free rectangle wins on ties
+class Lowest_score {
+protected:
+    bool improves(const int primary, const int secondary) noexcept
+    {
+        if(primary > m_primary or (primary == m_primary and secondary >= m_secondary)) return false;
+        m_primary = primary;
+        m_secondary = secondary;
+        return true;
+    }
+private:
+    int m_primary = std::numeric_limits<int>::max();
+    int m_secondary = std::numeric_limits<int>::max();
+};
+
+// the smallest leftover along the shorter side, then along the longer side
+class Best_short_side_fit : Lowest_score {
+public:
+    bool improves(const Rect& free_rect, const int w, const int h, const bool) noexcept
+    {
+        const int unused_width = free_rect.w - w;
+        const int unused_height = free_rect.h - h;
+        return Lowest_score::improves(std::min(unused_width, unused_height), std::max(unused_width, unused_height));
+    }
+};
+
+// the smallest leftover along the longer side, then along the shorter side
+class Best_long_side_fit : Lowest_score {
+public:
+    bool improves(const Rect& free_rect, const int w, const int h, const bool) noexcept
+    {
+        const int unused_width = free_rect.w - w;
+        const int unused_height = free_rect.h - h;
+        return Lowest_score::improves(std::max(unused_width, unused_height), std::min(unused_width, unused_height));
+    }
+};
+
+// Jylänki's Bottom-Left rule: the lowest bottom edge, then the leftmost; the y axis of the atlases points down
+class Top_left : Lowest_score {
+public:
+    bool improves(const Rect& free_rect, const int, const int h, const bool) noexcept
+    {
+        return Lowest_score::improves(free_rect.y + h, free_rect.x);
+    }
+};
+
+/*
+This class implements the Maximal Rectangles algorithm as described in Jukka Jylänki's document:
+https://github.com/juj/RectangleBinPack/blob/master/RectangleBinPack.pdf
+Bin_base keeps the free rectangles, Basic_bin adds the search for the best one, with the scoring
+policy and the multiple bins behaviour fixed at compile time so the search loop of each policy is
+inlined and has no branch on them.
+
+With 'allow_rotation', each rectangle is also scored turned 90 degrees and insert() may place it
+that way, swapping its 'w' and 'h' and setting 'rotated'.
+*/
+class Bin_base {
+public:
+    void occupy(const Rect& used) noexcept; // marks an already placed rectangle as used space
+    void release(const Rect& used); // gives the space of a placed rectangle back to the bin
+    int64 largest_free_area() const noexcept;
     int processed_rectangles() const noexcept;
     void reset() noexcept;
-private:
-    bool fits(const Rect& a, const Rect& b) noexcept; // does 'b' fits in 'a'?
-    bool overlaps(const Rect& a, const Rect& b) noexcept;
+    const Bin_stats& stats() const noexcept { return m_stats; }
+    void enable_timing() noexcept { m_timed = true; }
+protected:
+    Bin_base(const int width, const int height, const bool allow_rotation) noexcept;
+
+    void new_page() noexcept; // with multiple bins, the current bin is full and an empty one takes its place
+    [[noreturn]] static void throw_too_large(const Rect& r);
+    static bool fits(const Rect& a, const Rect& b) noexcept; // does 'b' fits in 'a'?
+    static bool overlaps(const Rect& a, const Rect& b) noexcept;
     bool inside(const Rect& a, const Rect& b) noexcept; // is 'b' completely inside 'a'?
-    std::list<Rect>::const_iterator find_best_free_rectangle(const Rect& outsider) noexcept;
     void compute_new_free_rectangles(const Rect& free_rect, const Rect& inserted_rect) noexcept;
 
     std::list<Rect> m_free_rectangles;
@@ -37,5 +166,169 @@ private:
     int m_processed_rectangles = 0;
     const int m_width;
     const int m_height;
-    const bool m_multiple_bins;
+    const bool m_allow_rotation;
+    Bin_stats m_stats;
+    bool m_timed = false;
+};
+
+template<typename Score_policy, bool Multiple_bins>
+class Basic_bin : public Bin_base {
+public:
+    Basic_bin(const int width, const int height, const bool allow_rotation = false) noexcept
+        : Bin_base {width, height, allow_rotation}
+    {
+    }
+
+    void layout_bulk(std::vector<Rect>& container);
+    bool insert(Rect& r) noexcept; // places 'r' in the current bin, returns false if it doesn't fit
+private:
+    std::list<Rect>::const_iterator find_best_free_rectangle(const Rect& outsider, bool& rotate) noexcept;
 };
+
+using Bin = Basic_bin<Best_area_fit, false>;
+
+template<typename Score_policy, bool Multiple_bins>
+void Basic_bin<Score_policy, Multiple_bins>::layout_bulk(std::vector<Rect>& container)
+{
+    int bin_instance = 0;
+    for(Rect& r : container) {
+        if(not insert(r)) { // no more rectangles fit in the bin
+            if constexpr(not Multiple_bins) break;
+            else {
+                new_page();
+                ++bin_instance;
+                if(not insert(r)) throw_too_large(r);
+            }
+        }
+        r.bin = bin_instance;
+        ++m_processed_rectangles;
+    }
+}
+
+template<typename Score_policy, bool Multiple_bins>
+bool Basic_bin<Score_policy, Multiple_bins>::insert(Rect& r) noexcept
+{
+    /* search the best free rectangle */
+    bool rotate = false;
+    const auto search_start = m_timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point {};
+    auto it = find_best_free_rectangle(r, rotate);
+    if(m_timed) m_stats.search_time += std::chrono::steady_clock::now() - search_start;
+    ++m_stats.searches;
+    m_stats.searched_free_rectangles += m_free_rectangles.size();
+    if(it == m_free_rectangles.cend()) return false;
+    if(rotate) {
+        std::swap(r.w, r.h);
+        r.rotated = not r.rotated;
+    }
+    r.x = it->x;
+    r.y = it->y;
+    occupy(r);
+    return true;
+}
+
+template<typename Score_policy, bool Multiple_bins>
+std::list<Rect>::const_iterator Basic_bin<Score_policy, Multiple_bins>::find_best_free_rectangle(const Rect& outsider, bool& rotate) noexcept
+{
+    Score_policy policy;
+    // the turned orientation only differs for non-square rectangles
+    Rect turned = outsider;
+    std::swap(turned.w, turned.h);
+    const bool try_turned = m_allow_rotation and outsider.w != outsider.h;
+
+    auto iter_result = m_free_rectangles.cend();
+    auto iter_end = m_free_rectangles.cend();
+    for(auto iter = m_free_rectangles.cbegin(); iter != iter_end; ++iter) {
+        const Rect& free_rect = *iter;
+        if(fits(free_rect, outsider) and policy.improves(free_rect, outsider.w, outsider.h, false)) {
+            iter_result = iter;
+            rotate = false;
+        }
+        if(try_turned and fits(free_rect, turned) and policy.improves(free_rect, turned.w, turned.h, true)) {
+            iter_result = iter;
+            rotate = true;
+        }
+    }
+    return iter_result;
+}
+
+/*
+Packs 'container', sorted like for layout_bulk, into as many bins as needed, several bins at once
+(-parallel-pack). The rectangles are first split into runs whose total area should fill a bin,
+each run is packed into its own bin on its own thread, then the rectangles that didn't fit are
+placed serially, first in the bins that still have room, in order, and then in new bins.
+The result only depends on 'container', not on the number of threads.
+Throws like layout_bulk if a rectangle doesn't fit in an empty bin.
+*/
+template<typename Score_policy>
+Bin_stats layout_parallel(std::vector<Rect>& container, const int width, const int height, const bool allow_rotation, const bool timed)
+{
+    /* partition: a bin holds about this much of the area of the rectangles, the rest is lost between them */
+    constexpr int64 fill_percent = 85;
+    const int64 run_area = static_cast<int64>(width) * height * fill_percent / 100;
+    std::vector<std::size_t> run_starts;
+    int64 area = run_area;
+    for(std::size_t i = 0; i < container.size(); ++i) {
+        if(area + container[i].area() > run_area) {
+            run_starts.push_back(i);
+            area = 0;
+        }
+        area += container[i].area();
+    }
+    run_starts.push_back(container.size());
+    const std::size_t run_count = run_starts.size() - 1;
+
+    /* pack each run into its own bin */
+    std::vector<Basic_bin<Score_policy, false>> bins;
+    bins.reserve(run_count);
+    for(std::size_t i = 0; i < run_count; ++i) {
+        bins.emplace_back(width, height, allow_rotation);
+        if(timed) bins.back().enable_timing();
+    }
+    std::vector<std::vector<std::size_t>> overflows(run_count); // the rectangles of each run that didn't fit
+    std::atomic<std::size_t> next_run {0};
+    auto work = [&] {
+        for(std::size_t run = next_run++; run < run_count; run = next_run++) {
+            for(std::size_t i = run_starts[run]; i < run_starts[run + 1]; ++i) {
+                if(bins[run].insert(container[i])) container[i].bin = static_cast<int>(run);
+                else overflows[run].push_back(i);
+            }
+        }
+    };
+    const unsigned thread_count = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), run_count);
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < thread_count; ++i) threads.emplace_back(work);
+    work();
+    for(std::thread& t : threads) t.join();
+
+    /* repair: the overflow, in the order of the container, goes to the first bin with room for it */
+    std::vector<Rect> rest;
+    std::vector<std::size_t> rest_indices;
+    for(const std::vector<std::size_t>& overflow : overflows) {
+        for(const std::size_t i : overflow) {
+            bool placed = false;
+            for(std::size_t b = 0; b < run_count and not placed; ++b) {
+                if(bins[b].largest_free_area() < container[i].area()) continue;
+                if(bins[b].insert(container[i])) {
+                    container[i].bin = static_cast<int>(b);
+                    placed = true;
+                }
+            }
+            if(not placed) {
+                rest.push_back(container[i]);
+                rest_indices.push_back(i);
+            }
+        }
+    }
+    Bin_stats stats;
+    for(const auto& bin : bins) stats += bin.stats();
+    if(rest.empty()) return stats;
+    Basic_bin<Score_policy, true> rest_bin {width, height, allow_rotation};
+    if(timed) rest_bin.enable_timing();
+    rest_bin.layout_bulk(rest);
+    for(std::size_t i = 0; i < rest.size(); ++i) {
+        container[rest_indices[i]] = rest[i];
+        container[rest_indices[i]].bin += static_cast<int>(run_count);
+    }
+    stats += rest_bin.stats();
+    return stats;
+}
@@ -0,0 +1,326 @@
+#include "msdf.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#include FT_OUTLINE_H
+
+namespace {
+
+constexpr uint8 red = 1;
+constexpr uint8 green = 2;
+constexpr uint8 blue = 4;
+constexpr uint8 cyan = green | blue;
+constexpr uint8 magenta = red | blue;
+constexpr uint8 yellow = red | green;
+constexpr uint8 white = red | green | blue;
+
+// two edges meet at a corner when the angle between their directions is larger than ~8 degrees
+constexpr float corner_threshold = 0.1411f; // sin(3.0), the value msdfgen uses
+
+struct Point {
+    float x = 0.0f;
+    float y = 0.0f;
+};
+
+Point operator-(const Point& lhs, const Point& rhs) noexcept { return Point {lhs.x - rhs.x, lhs.y - rhs.y}; }
+bool is_zero(const Point& p) noexcept { return p.x == 0.0f and p.y == 0.0f; }
+
+struct Edge {
+    Point p[4];
+    int degree = 1; // 1: line, 2: conic (quadratic), 3: cubic
+    uint8 color = white;
+
+    Point start_direction() const noexcept
+    {
+        for(int i = 1; i <= degree; ++i) {
+            const Point d = p[i] - p[0];
+            if(not is_zero(d)) return d;
+        }
+        return Point {};
+    }
+    Point end_direction() const noexcept
+    {
+        for(int i = degree - 1; i >= 0; --i) {
+            const Point d = p[degree] - p[i];
+            if(not is_zero(d)) return d;
+        }
+        return Point {};
+    }
+    Point point_at(const float t) const noexcept
+    {
+        const float s = 1.0f - t;
+        if(degree == 1) return Point {s * p[0].x + t * p[1].x, s * p[0].y + t * p[1].y};
+        if(degree == 2) {
+            return Point {s * s * p[0].x + 2.0f * s * t * p[1].x + t * t * p[2].x,
+                          s * s * p[0].y + 2.0f * s * t * p[1].y + t * t * p[2].y};
+        }
+        return Point {s * s * s * p[0].x + 3.0f * s * s * t * p[1].x + 3.0f * s * t * t * p[2].x + t * t * t * p[3].x,
+                      s * s * s * p[0].y + 3.0f * s * s * t * p[1].y + 3.0f * s * t * t * p[2].y + t * t * t * p[3].y};
+    }
+    int flattened_segments() const noexcept
+    {
+        if(degree == 1) return 1;
+        float length = 0.0f; // of the control polygon, in pixels
+        for(int i = 0; i < degree; ++i) length += std::hypot(p[i + 1].x - p[i].x, p[i + 1].y - p[i].y);
+        return std::clamp(static_cast<int>(length / 1.5f) + 1, 2, 16);
+    }
+};
+
+struct Decomposition {
+    std::vector<std::vector<Edge>> contours;
+    Point current;
+};
+
+Point to_point(const FT_Vector* v) noexcept
+{
+    return Point {static_cast<float>(v->x) / 64.0f, static_cast<float>(v->y) / 64.0f};
+}
+
+void add_edge(Decomposition& d, Edge& e, const FT_Vector* to)
+{
+    e.p[0] = d.current;
+    e.p[e.degree] = to_point(to);
+    d.current = e.p[e.degree];
+    if(is_zero(e.start_direction())) return; // degenerate
+    d.contours.back().push_back(e);
+}
+
+int move_to(const FT_Vector* to, void* user)
+{
+    Decomposition& d = *static_cast<Decomposition*>(user);
+    d.contours.emplace_back();
+    d.current = to_point(to);
+    return 0;
+}
+
+int line_to(const FT_Vector* to, void* user)
+{
+    Edge e;
+    e.degree = 1;
+    add_edge(*static_cast<Decomposition*>(user), e, to);
+    return 0;
+}
+
+int conic_to(const FT_Vector* control, const FT_Vector* to, void* user)
+{
+    Edge e;
+    e.degree = 2;
+    e.p[1] = to_point(control);
+    add_edge(*static_cast<Decomposition*>(user), e, to);
+    return 0;
+}
+
+int cubic_to(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user)
+{
+    Edge e;
+    e.degree = 3;
+    e.p[1] = to_point(control1);
+    e.p[2] = to_point(control2);
+    add_edge(*static_cast<Decomposition*>(user), e, to);
+    return 0;
+}
+
+bool is_corner(Point a, Point b) noexcept
+{
+    const float la = std::hypot(a.x, a.y);
+    const float lb = std::hypot(b.x, b.y);
+    a.x /= la; a.y /= la;
+    b.x /= lb; b.y /= lb;
+    return a.x * b.x + a.y * b.y <= 0.0f or std::fabs(a.x * b.y - a.y * b.x) > corner_threshold;
+}
+
+float median(const float a, const float b, const float c) noexcept
+{
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+} // namespace
+
+bool Msdf_shape::load(FT_Outline& outline, const int spread)
+{
+    m_spread = spread;
+    m_ax.clear(); m_ay.clear(); m_bx.clear(); m_by.clear();
+    m_color.clear(); m_ends.clear();
+    if(outline.n_points == 0) { // blank glyphs, like the space, have an empty bitmap
+        m_width = m_rows = m_left = m_top = 0;
+        return true;
+    }
+
+    FT_BBox cbox;
+    FT_Outline_Get_CBox(&outline, &cbox);
+    const int x_min = static_cast<int>(cbox.xMin >> 6);
+    const int y_min = static_cast<int>(cbox.yMin >> 6);
+    const int x_max = static_cast<int>((cbox.xMax + 63) >> 6);
+    const int y_max = static_cast<int>((cbox.yMax + 63) >> 6);
+    m_left = x_min - spread;
+    m_top = y_max + spread;
+    m_width = x_max - x_min + 2 * spread;
+    m_rows = y_max - y_min + 2 * spread;
+    m_inside_sign = FT_Outline_Get_Orientation(&outline) == FT_ORIENTATION_TRUETYPE ? -1.0f : 1.0f;
+    m_even_odd = (outline.flags & FT_OUTLINE_EVEN_ODD_FILL) != 0;
+
+    Decomposition decomposition;
+    FT_Outline_Funcs funcs;
+    funcs.move_to = move_to;
+    funcs.line_to = line_to;
+    funcs.conic_to = conic_to;
+    funcs.cubic_to = cubic_to;
+    funcs.shift = 0;
+    funcs.delta = 0;
+    if(FT_Outline_Decompose(&outline, &funcs, &decomposition)) return false;
+
+    for(std::vector<Edge>& edges : decomposition.contours) {
+        const int n = static_cast<int>(edges.size());
+        if(n == 0) continue;
+
+        /* colour the edges: the colour changes at every corner */
+        std::vector<int> corners;
+        for(int i = 0; i < n; ++i) {
+            if(is_corner(edges[(i + n - 1) % n].end_direction(), edges[i].start_direction())) corners.push_back(i);
+        }
+        const int start = corners.empty() ? 0 : corners.front();
+        const int spline_count = static_cast<int>(corners.size());
+        constexpr uint8 palette[3] {magenta, cyan, yellow};
+        int spline = 0;
+        for(int j = 0; j < n; ++j) {
+            const int i = (start + j) % n;
+            if(j > 0 and std::find(corners.begin(), corners.end(), i) != corners.end()) ++spline;
+            if(spline_count < 2) { edges[i].color = white; continue; }
+            // the last spline touches the first one, so they can't share a colour
+            if(spline == spline_count - 1 and spline_count % 3 == 1) edges[i].color = palette[1];
+            else edges[i].color = palette[spline % 3];
+        }
+
+        /* flatten the edges into segments */
+        const std::size_t first_segment = m_ax.size();
+        for(int j = 0; j < n; ++j) {
+            const Edge& e = edges[(start + j) % n];
+            const int count = e.flattened_segments();
+            Point a = e.p[0];
+            for(int k = 1; k <= count; ++k) {
+                const Point b = k == count ? e.p[e.degree] : e.point_at(static_cast<float>(k) / count);
+                if(is_zero(b - a)) continue;
+                add_segment(a.x, a.y, b.x, b.y, e.color);
+                if(k == 1) m_ends.back() |= 1;
+                if(k == count) m_ends.back() |= 2;
+                a = b;
+            }
+        }
+        /* a contour with a single corner (a teardrop) is split in three parts instead */
+        if(spline_count == 1) {
+            const std::size_t count = m_ax.size() - first_segment;
+            for(std::size_t k = 0; k < count; ++k) {
+                const std::size_t part = k * 3 / count;
+                m_color[first_segment + k] = part == 0 ? magenta : (part == 1 ? white : cyan);
+            }
+        }
+    }
+    return true;
+}
+
+std::size_t Msdf_shape::memory_size() const noexcept
+{
+    return sizeof(Msdf_shape) + (m_ax.capacity() + m_ay.capacity() + m_bx.capacity() + m_by.capacity()) * sizeof(float)
+           + m_color.capacity() + m_ends.capacity();
+}
+
+void Msdf_shape::add_segment(const float ax, const float ay, const float bx, const float by, const uint8 color)
+{
+    m_ax.push_back(ax);
+    m_ay.push_back(ay);
+    m_bx.push_back(bx);
+    m_by.push_back(by);
+    m_color.push_back(color);
+    m_ends.push_back(0);
+}
+
+void Msdf_shape::generate(uint8* pixels, const int pitch, Msdf_scratch& scratch) const
+{
+    const std::size_t n = m_ax.size();
+    scratch.squared_distances.resize(n); // only allocates for a glyph with more segments than the previous ones
+    scratch.crosses.resize(n);
+    scratch.params.resize(n);
+    float* const squared_distances = scratch.squared_distances.data();
+    float* const crosses = scratch.crosses.data();
+    float* const params = scratch.params.data();
+    const float to_levels = 128.0f / static_cast<float>(m_spread);
+
+    for(int y = 0; y < m_rows; ++y) {
+        uint8* row = pixels + static_cast<std::size_t>(y) * pitch;
+        const float py = static_cast<float>(m_top - y) - 0.5f;
+        for(int x = 0; x < m_width; ++x) {
+            const float px = static_cast<float>(m_left + x) + 0.5f;
+
+            /* branch-free pass over every segment */
+            int winding = 0;
+            for(std::size_t i = 0; i < n; ++i) {
+                const float dx = m_bx[i] - m_ax[i];
+                const float dy = m_by[i] - m_ay[i];
+                const float ex = px - m_ax[i];
+                const float ey = py - m_ay[i];
+                const float t = (ex * dx + ey * dy) / (dx * dx + dy * dy);
+                const float tc = std::clamp(t, 0.0f, 1.0f);
+                const float qx = ex - tc * dx;
+                const float qy = ey - tc * dy;
+                squared_distances[i] = qx * qx + qy * qy;
+                crosses[i] = dx * ey - dy * ex;
+                params[i] = t;
+                // nonzero/even-odd winding of a ray going towards +x
+                const bool crosses_ray = (m_ay[i] <= py) != (m_by[i] <= py);
+                const float x_at_py = m_ax[i] + (py - m_ay[i]) * dx / (dy == 0.0f ? 1.0f : dy);
+                winding += (crosses_ray and x_at_py > px) ? (dy > 0.0f ? 1 : -1) : 0;
+            }
+            const bool inside = m_even_odd ? (winding & 1) != 0 : winding != 0;
+
+            /* nearest segment of each channel, ties go to the most orthogonal one */
+            int best[3] {-1, -1, -1};
+            int nearest = -1;
+            for(std::size_t i = 0; i < n; ++i) {
+                const float d = squared_distances[i];
+                for(int c = 0; c < 3; ++c) {
+                    if(not (m_color[i] & (1 << c))) continue;
+                    if(best[c] == -1 or d < squared_distances[best[c]] * 0.9999f) { best[c] = static_cast<int>(i); }
+                    else if(d <= squared_distances[best[c]] * 1.0001f) {
+                        const float dx = m_bx[i] - m_ax[i], dy = m_by[i] - m_ay[i];
+                        const float bdx = m_bx[best[c]] - m_ax[best[c]], bdy = m_by[best[c]] - m_ay[best[c]];
+                        const float orthogonality = std::fabs(crosses[i]) / std::sqrt(dx * dx + dy * dy);
+                        const float best_orthogonality = std::fabs(crosses[best[c]]) / std::sqrt(bdx * bdx + bdy * bdy);
+                        if(orthogonality > best_orthogonality) best[c] = static_cast<int>(i);
+                    }
+                }
+                if(nearest == -1 or d < squared_distances[nearest]) nearest = static_cast<int>(i);
+            }
+            if(nearest == -1) { // no segments at all
+                for(int c = 0; c < 3; ++c) row[x * 3 + c] = 0;
+                continue;
+            }
+            const float true_distance = (inside ? 1.0f : -1.0f) * std::sqrt(squared_distances[nearest]);
+
+            float channels[3];
+            for(int c = 0; c < 3; ++c) {
+                const int i = best[c];
+                if(i == -1) {
+                    channels[c] = true_distance;
+                    continue;
+                }
+                const float dx = m_bx[i] - m_ax[i];
+                const float dy = m_by[i] - m_ay[i];
+                const float side = m_inside_sign * (crosses[i] >= 0.0f ? 1.0f : -1.0f);
+                // past the ends of an edge the distance is measured to the edge's extension
+                const bool beyond_start = params[i] < 0.0f and (m_ends[i] & 1);
+                const bool beyond_end = params[i] > 1.0f and (m_ends[i] & 2);
+                if(beyond_start or beyond_end) channels[c] = m_inside_sign * crosses[i] / std::sqrt(dx * dx + dy * dy);
+                else channels[c] = side * std::sqrt(squared_distances[i]);
+            }
+            // the median must agree with the real inside/outside test, otherwise fall back to a plain SDF
+            if((median(channels[0], channels[1], channels[2]) > 0.0f) != inside) {
+                channels[0] = channels[1] = channels[2] = true_distance;
+            }
+            for(int c = 0; c < 3; ++c) {
+                const float level = std::clamp(128.0f + channels[c] * to_levels, 0.0f, 255.0f);
+                row[x * 3 + c] = static_cast<uint8>(level + 0.5f);
+            }
+        }
+    }
+}
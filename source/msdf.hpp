@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "mystdint.hpp"
+
+/*
+Multi-channel signed distance field of a single glyph, as described in Viktor Chlumský's
+thesis "Shape Decomposition for Multi-channel Distance Fields".
+
+The outline is decomposed with FT_Outline_Decompose, the edges are coloured at the corners
+and the curves are flattened into line segments. Each channel holds the signed pseudo-distance
+to the nearest segment of its colour; the median of the three channels reconstructs the
+outline with sharp corners. Pixels whose median disagrees with the real inside/outside test
+fall back to the plain signed distance in all three channels.
+
+The output uses the same padding, metrics and encoding as the single-channel SDF glyphs.
+*/
+// per-segment working memory of Msdf_shape::generate, a thread reuses it for all its glyphs
+struct Msdf_scratch {
+    std::vector<float> squared_distances;
+    std::vector<float> crosses; // cross product of the segment's direction and (pixel - start)
+    std::vector<float> params; // unclamped position of the nearest point along the segment
+};
+
+class Msdf_shape {
+public:
+    // 'outline' is in 26.6 pixel units, returns false if it can't be decomposed
+    bool load(FT_Outline& outline, const int spread);
+
+    int width() const noexcept { return m_width; }
+    int rows() const noexcept { return m_rows; }
+    int left() const noexcept { return m_left; }
+    int top() const noexcept { return m_top; }
+    std::size_t memory_size() const noexcept; // of the segments, for -max-memory
+
+    // writes rows() rows of width() RGB pixels, 'pitch' bytes apart; safe to call from many threads,
+    // each with its own 'scratch'
+    void generate(uint8* pixels, const int pitch, Msdf_scratch& scratch) const;
+private:
+    void add_segment(const float ax, const float ay, const float bx, const float by, const uint8 color);
+
+    // the segments are stored as a structure of arrays so the per-pixel loop can be vectorised
+    std::vector<float> m_ax;
+    std::vector<float> m_ay;
+    std::vector<float> m_bx;
+    std::vector<float> m_by;
+    std::vector<uint8> m_color; // bit 0: red, bit 1: green, bit 2: blue
+    std::vector<uint8> m_ends; // bit 0: starts an edge, bit 1: ends an edge (pseudo-distance applies there)
+    float m_inside_sign = 1.0f; // turns the cross product of a segment into "positive inside"
+    bool m_even_odd = false;
+    int m_spread = 0;
+    int m_width = 0;
+    int m_rows = 0;
+    int m_left = 0;
+    int m_top = 0;
+};
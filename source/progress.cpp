@@ -0,0 +1,106 @@
+#include "progress.hpp"
+
+#include <iostream>
+#include <string>
+#include <atomic>
+
+namespace {
+
+std::atomic<uint64> processed_glyphs {0};
+std::atomic<uint64> packed_pages {0};
+std::atomic<uint64> encoded_pages {0};
+std::atomic<uint64> written_bytes {0};
+
+} // namespace
+
+void count_processed_glyph() noexcept
+{
+    processed_glyphs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void count_packed_pages(const std::size_t count) noexcept
+{
+    packed_pages.fetch_add(count, std::memory_order_relaxed);
+}
+
+void count_encoded_page() noexcept
+{
+    encoded_pages.fetch_add(1, std::memory_order_relaxed);
+}
+
+void count_written_bytes(const std::size_t size) noexcept
+{
+    written_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void Progress_report::start()
+{
+    m_start = std::chrono::steady_clock::now();
+    m_phase_start = m_start;
+    m_thread = std::thread {&Progress_report::run, this};
+}
+
+void Progress_report::begin_phase(const char* name, const uint64 glyph_total)
+{
+    std::lock_guard lock {m_mutex};
+    m_phase = name;
+    m_glyph_total = glyph_total;
+    m_glyph_base = processed_glyphs.load(std::memory_order_relaxed);
+    m_phase_start = std::chrono::steady_clock::now();
+}
+
+void Progress_report::finish()
+{
+    stop();
+    begin_phase("done", 0);
+    write_line();
+}
+
+void Progress_report::run()
+{
+    std::unique_lock lock {m_mutex};
+    while(not m_wake.wait_for(lock, std::chrono::seconds {1}, [this] { return m_stopping; })) {
+        lock.unlock();
+        write_line();
+        lock.lock();
+    }
+}
+
+void Progress_report::stop() noexcept
+{
+    if(not m_thread.joinable()) return;
+    {
+        std::lock_guard lock {m_mutex};
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+/* Status line format:
+progress:<milliseconds since the start>:<phase>:<glyphs processed in the phase>:<glyphs the phase processes>:<glyphs per second>:
+<pages packed>:<pages encoded>:<bytes of atlases written>:<seconds left in the phase, -1 if unknown>
+*/
+void Progress_report::write_line()
+{
+    std::unique_lock lock {m_mutex};
+    const auto now = std::chrono::steady_clock::now();
+    const uint64 glyphs = processed_glyphs.load(std::memory_order_relaxed) - m_glyph_base;
+    const double phase_seconds = std::chrono::duration<double> {now - m_phase_start}.count();
+    const uint64 rate = phase_seconds > 0.0 ? static_cast<uint64>(glyphs / phase_seconds) : 0;
+    int64 eta = -1;
+    if(m_glyph_total > 0 and glyphs > 0) eta = glyphs >= m_glyph_total ? 0 : static_cast<int64>((m_glyph_total - glyphs) * phase_seconds / glyphs + 0.5);
+
+    std::string line {"progress:"};
+    line.append(std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(now - m_start).count()));
+    line.append(1, ':').append(m_phase);
+    line.append(1, ':').append(std::to_string(glyphs));
+    line.append(1, ':').append(std::to_string(m_glyph_total));
+    lock.unlock();
+    line.append(1, ':').append(std::to_string(rate));
+    line.append(1, ':').append(std::to_string(packed_pages.load(std::memory_order_relaxed)));
+    line.append(1, ':').append(std::to_string(encoded_pages.load(std::memory_order_relaxed)));
+    line.append(1, ':').append(std::to_string(written_bytes.load(std::memory_order_relaxed)));
+    line.append(1, ':').append(std::to_string(eta)).append(1, '\n');
+    std::cerr << line;
+}
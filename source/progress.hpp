@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "mystdint.hpp"
+
+/*
+Status stream of long runs (-progress). The work done is counted with relaxed atomic increments,
+from the main thread and from the worker threads alike, and a reporting thread samples the
+counters once a second and writes a status line to stderr. Counting costs an uncontended atomic
+add per glyph, page or write, and nothing ever waits on the report.
+*/
+
+void count_processed_glyph() noexcept; // a glyph of the current phase is done
+void count_packed_pages(const std::size_t count) noexcept;
+void count_encoded_page() noexcept;
+void count_written_bytes(const std::size_t size) noexcept; // of the atlases
+
+class Progress_report {
+public:
+    Progress_report() noexcept {}
+    ~Progress_report() { stop(); }
+    Progress_report(const Progress_report&) = delete;
+    Progress_report& operator=(const Progress_report&) = delete;
+
+    void start();
+    // 'glyph_total' is the number of glyphs the phase processes, 0 if it doesn't process glyphs
+    void begin_phase(const char* name, const uint64 glyph_total);
+    void finish(); // writes the last line, with "done" as the phase
+private:
+    void run();
+    void stop() noexcept;
+    void write_line();
+
+    std::thread m_thread;
+    std::mutex m_mutex; // guards everything below, the counters don't need it
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_phase_start;
+    const char* m_phase = "";
+    uint64 m_glyph_total = 0;
+    uint64 m_glyph_base = 0; // the glyphs processed before the phase began
+};
@@ -0,0 +1,152 @@
+#include "sdf.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+
+#include FT_OUTLINE_H
+#include FT_BITMAP_H
+
+namespace {
+
+constexpr float infinity = 1e20f;
+static_assert(std::has_single_bit(static_cast<unsigned>(Sdf_generator::supersampling)), "render() undoes the scaling of the outline exactly");
+
+} // namespace
+
+bool Sdf_generator::render(FT_GlyphSlot slot)
+{
+    if(slot->format != FT_GLYPH_FORMAT_OUTLINE) return false;
+
+    FT_Outline& outline = slot->outline;
+    if(outline.n_points == 0) { // blank glyphs, like the space, have an empty bitmap
+        m_width = m_rows = m_left = m_top = 0;
+        m_pixels.clear();
+        return true;
+    }
+
+    /* the padded bounding box, in pixels of the final bitmap */
+    FT_BBox cbox;
+    FT_Outline_Get_CBox(&outline, &cbox);
+    const int x_min = static_cast<int>(cbox.xMin >> 6);
+    const int y_min = static_cast<int>(cbox.yMin >> 6);
+    const int x_max = static_cast<int>((cbox.xMax + 63) >> 6);
+    const int y_max = static_cast<int>((cbox.yMax + 63) >> 6);
+    m_left = x_min - m_spread;
+    m_top = y_max + m_spread;
+    m_width = x_max - x_min + 2 * m_spread;
+    m_rows = y_max - y_min + 2 * m_spread;
+
+    /* rasterise the outline at the supersampled resolution */
+    const int width = m_width * supersampling;
+    const int height = m_rows * supersampling;
+    const std::size_t size = static_cast<std::size_t>(width) * height;
+    m_coverage.assign(size, 0);
+    const FT_Pos dx = -m_left * 64;
+    const FT_Pos dy = -(y_min - m_spread) * 64;
+    FT_Outline_Translate(&outline, dx, dy);
+    FT_Matrix scale {supersampling * 0x10000, 0, 0, supersampling * 0x10000};
+    FT_Outline_Transform(&outline, &scale);
+    FT_Bitmap target;
+    FT_Bitmap_Init(&target);
+    target.width = width;
+    target.rows = height;
+    target.pitch = width;
+    target.buffer = m_coverage.data();
+    target.pixel_mode = FT_PIXEL_MODE_GRAY;
+    target.num_grays = 256;
+    const FT_Error error = FT_Outline_Get_Bitmap(m_library, &outline, &target);
+    // the slot's outline is given back as it was (exactly, the scale is a power of two), on failure
+    // the caller renders it with FreeType instead
+    FT_Matrix unscale {0x10000 / supersampling, 0, 0, 0x10000 / supersampling};
+    FT_Outline_Transform(&outline, &unscale);
+    FT_Outline_Translate(&outline, -dx, -dy);
+    if(error) return false;
+
+    /* seed both transforms, edge pixels start at their subpixel distance from the outline */
+    m_outer.resize(size);
+    m_inner.resize(size);
+    for(std::size_t i = 0; i < size; ++i) {
+        const float a = m_coverage[i] * (1.0f / 255.0f);
+        const float outer = std::max(0.0f, 0.5f - a);
+        const float inner = std::max(0.0f, a - 0.5f);
+        m_outer[i] = m_coverage[i] == 255 ? 0.0f : (m_coverage[i] == 0 ? infinity : outer * outer);
+        m_inner[i] = m_coverage[i] == 0 ? 0.0f : (m_coverage[i] == 255 ? infinity : inner * inner);
+    }
+    transform(m_outer, width, height);
+    transform(m_inner, width, height);
+
+    /* average each block of subpixels into a final pixel and encode it like FreeType does */
+    const float scale_to_levels = 128.0f / (static_cast<float>(supersampling) * supersampling * supersampling * m_spread);
+    m_pixels.resize(static_cast<std::size_t>(m_width) * m_rows);
+    for(int y = 0; y < m_rows; ++y) {
+        for(int x = 0; x < m_width; ++x) {
+            float sum = 0.0f;
+            for(int sy = 0; sy < supersampling; ++sy) {
+                const std::size_t row = static_cast<std::size_t>(y * supersampling + sy) * width + x * supersampling;
+                for(int sx = 0; sx < supersampling; ++sx) {
+                    sum += std::sqrt(m_inner[row + sx]) - std::sqrt(m_outer[row + sx]); // positive inside
+                }
+            }
+            const float level = std::clamp(128.0f + sum * scale_to_levels, 0.0f, 255.0f);
+            m_pixels[static_cast<std::size_t>(y) * m_width + x] = static_cast<uint8>(level + 0.5f);
+        }
+    }
+    return true;
+}
+
+// separable 2D transform: every column first, then every row
+void Sdf_generator::transform(std::vector<float>& grid, const int width, const int height)
+{
+    const int n = std::max(width, height);
+    m_f.resize(n);
+    m_d.resize(n);
+    m_z.resize(n + 1);
+    m_v.resize(n);
+
+    for(int x = 0; x < width; ++x) {
+        for(int y = 0; y < height; ++y) m_f[y] = grid[static_cast<std::size_t>(y) * width + x];
+        transform_1d(height);
+        for(int y = 0; y < height; ++y) grid[static_cast<std::size_t>(y) * width + x] = m_d[y];
+    }
+    for(int y = 0; y < height; ++y) {
+        float* row = grid.data() + static_cast<std::size_t>(y) * width;
+        std::memcpy(m_f.data(), row, width * sizeof(float));
+        transform_1d(width);
+        std::memcpy(row, m_d.data(), width * sizeof(float));
+    }
+}
+
+// lower envelope of the parabolas rooted at each sample of m_f, written to m_d
+void Sdf_generator::transform_1d(const int n) noexcept
+{
+    const float* f = m_f.data();
+    float* d = m_d.data();
+    float* z = m_z.data();
+    int* v = m_v.data();
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -infinity;
+    z[1] = infinity;
+    for(int q = 1; q < n; ++q) {
+        // the seeds never exceed 'infinity', so 's' can't go below z[0] and k never goes negative
+        float s = ((f[q] + static_cast<float>(q) * q) - (f[v[k]] + static_cast<float>(v[k]) * v[k])) / static_cast<float>(2 * (q - v[k]));
+        while(s <= z[k]) {
+            --k;
+            s = ((f[q] + static_cast<float>(q) * q) - (f[v[k]] + static_cast<float>(v[k]) * v[k])) / static_cast<float>(2 * (q - v[k]));
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = infinity;
+    }
+
+    k = 0;
+    for(int q = 0; q < n; ++q) {
+        while(z[k + 1] < q) ++k;
+        const float distance = static_cast<float>(q - v[k]);
+        d[q] = distance * distance + f[v[k]];
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "mystdint.hpp"
+
+/*
+Signed distance field generator used as an alternative to FreeType's FT_RENDER_MODE_SDF.
+The outline is rasterised at 'supersampling' times the resolution, then the exact Euclidean
+distance transform described in Felzenszwalb and Huttenlocher's "Distance Transforms of
+Sampled Functions" is run over the rows and the columns of the result. Antialiased edge
+pixels seed the transform with their subpixel distance, like Mapbox's TinySDF does.
+
+The output follows FreeType's conventions: the bitmap is padded with 'spread' pixels on every
+side, 128 is the outline, greater values are inside and 'spread' pixels map to 128 levels.
+*/
+class Sdf_generator {
+public:
+    static constexpr int supersampling = 4;
+
+    Sdf_generator(FT_Library library, const int spread) noexcept : m_library {library}, m_spread {spread} {}
+
+    // renders the outline loaded in 'slot', returns false for non-outline glyphs (embedded bitmaps)
+    bool render(FT_GlyphSlot slot);
+
+    const uint8* pixels() const noexcept { return m_pixels.data(); }
+    int width() const noexcept { return m_width; }
+    int rows() const noexcept { return m_rows; }
+    int left() const noexcept { return m_left; }
+    int top() const noexcept { return m_top; }
+private:
+    void transform(std::vector<float>& grid, const int width, const int height);
+    void transform_1d(const int n) noexcept;
+
+    FT_Library m_library;
+    const int m_spread;
+    // kept between glyphs to avoid allocating for each one
+    std::vector<uint8> m_coverage;
+    std::vector<float> m_outer; // squared distance to the nearest inside pixel
+    std::vector<float> m_inner; // squared distance to the nearest outside pixel
+    std::vector<float> m_f;
+    std::vector<float> m_d;
+    std::vector<float> m_z;
+    std::vector<int> m_v;
+    std::vector<uint8> m_pixels;
+    int m_width = 0;
+    int m_rows = 0;
+    int m_left = 0;
+    int m_top = 0;
+};
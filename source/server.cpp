@@ -0,0 +1,503 @@
+#include "server.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <queue>
+#include <condition_variable>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include "mystdint.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif // _WIN32
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif // __linux__
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/* Protocol (one request per line, every number is in decimal):
+glyphs <font-size> <sdf: 0 or 1> <code point>,<code point>,... <font file>
+quit
+
+Answer to 'glyphs':
+ok <number of glyphs>
+and then, for each requested code point, in the same order:
+<code point>:<width>:<height>:<left bearing>:<top bearing>:<advance x>:<advance y>
+followed by width * height bytes of pixel data (no padding), or, if the font lacks it:
+<code point>:missing
+
+Anything that goes wrong is answered with a single line:
+error <message>
+*/
+
+namespace {
+
+struct Cached_glyph {
+    int width = 0;
+    int height = 0;
+    int left_bearing = 0;
+    int top_bearing = 0;
+    int advance_x = 0;
+    int advance_y = 0;
+    std::vector<uint8> pixels;
+};
+
+struct Sized_face {
+    FT_Face face = nullptr;
+    uint32 id = 0;
+    std::mutex mutex; // a face can only be used by one thread at a time
+};
+
+class Connection {
+public:
+    virtual ~Connection() = default;
+    virtual bool read_line(std::string& line) = 0;
+    virtual bool write(const std::string& data) = 0;
+};
+
+class Standard_streams_connection : public Connection {
+public:
+    Standard_streams_connection()
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif // _WIN32
+    }
+    bool read_line(std::string& line) override
+    {
+        if(not std::getline(std::cin, line)) return false;
+        if(not line.empty() and line.back() == '\r') line.pop_back();
+        return true;
+    }
+    bool write(const std::string& data) override
+    {
+        if(std::fwrite(data.data(), 1, data.size(), stdout) != data.size()) return false;
+        return std::fflush(stdout) == 0;
+    }
+};
+
+#ifdef __linux__
+// a client of the socket, its requests are read as they arrive, without waiting for whole lines
+class Socket_connection {
+public:
+    explicit Socket_connection(const int fd) noexcept : m_fd {fd} {}
+    ~Socket_connection() { close(m_fd); }
+    Socket_connection(const Socket_connection&) = delete;
+    Socket_connection& operator=(const Socket_connection&) = delete;
+
+    int fd() const noexcept { return m_fd; }
+    // reads what the client has sent, false once it has gone away
+    bool receive()
+    {
+        char chunk[4096];
+        const ssize_t received = recv(m_fd, chunk, sizeof(chunk), 0);
+        if(received <= 0) return false;
+        m_buffer.append(chunk, static_cast<std::size_t>(received));
+        return true;
+    }
+    // false if no whole line has been received yet
+    bool next_line(std::string& line)
+    {
+        const std::size_t newline = m_buffer.find('\n', m_scanned);
+        if(newline == std::string::npos) {
+            m_scanned = m_buffer.size();
+            return false;
+        }
+        line.assign(m_buffer, 0, newline);
+        m_buffer.erase(0, newline + 1);
+        m_scanned = 0;
+        if(not line.empty() and line.back() == '\r') line.pop_back();
+        return true;
+    }
+    bool write(const std::string& data)
+    {
+        std::size_t sent = 0;
+        while(sent < data.size()) {
+            const ssize_t n = send(m_fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0) return false;
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+private:
+    const int m_fd;
+    std::string m_buffer;
+    std::size_t m_scanned = 0;
+};
+#endif // __linux__
+
+class Glyph_server {
+public:
+    explicit Glyph_server(const std::filesystem::path& exe_dir) : m_exe_dir {exe_dir} {}
+    ~Glyph_server();
+
+    bool init();
+    void serve(Connection& connection);
+    // false for a quit request, 'answer' is left empty if there is nothing to answer
+    bool answer(const std::string& request, std::string& answer);
+private:
+    Sized_face* get_face(const std::string& font_file, const int font_size, std::string& error);
+    std::shared_ptr<const Cached_glyph> get_glyph(Sized_face& sized_face, const char32_t code_point, const bool sdf);
+    bool answer_glyphs(const std::string& request, std::string& answer);
+
+    const std::filesystem::path m_exe_dir;
+    FT_Library m_freetype_library = nullptr;
+    std::mutex m_faces_mutex; // also serialises face creation, which FreeType requires
+    std::map<std::string, std::vector<uint8>> m_font_files;
+    std::map<std::pair<std::string, int>, std::unique_ptr<Sized_face>> m_faces;
+    std::shared_mutex m_cache_mutex;
+    std::unordered_map<uint64, std::shared_ptr<const Cached_glyph>> m_cache; // key: face id, sdf and code point
+};
+
+Glyph_server::~Glyph_server()
+{
+    for(auto& [key, sized_face] : m_faces) FT_Done_Face(sized_face->face);
+    if(m_freetype_library) FT_Done_FreeType(m_freetype_library);
+}
+
+bool Glyph_server::init()
+{
+    return FT_Init_FreeType(&m_freetype_library) == 0;
+}
+
+void Glyph_server::serve(Connection& connection)
+{
+    std::string line;
+    std::string answer;
+    while(connection.read_line(line)) {
+        if(not this->answer(line, answer)) return;
+        if(not answer.empty() and not connection.write(answer)) return;
+    }
+}
+
+bool Glyph_server::answer(const std::string& request, std::string& answer)
+{
+    answer.clear();
+    if(request.empty()) return true;
+    if(request == "quit") return false;
+
+    if(request.starts_with("glyphs ")) {
+        if(not answer_glyphs(request, answer)) {
+            answer.insert(0, "error ");
+            answer.append(1, '\n');
+        }
+    }
+    else { answer = "error Unknown request.\n"; }
+    return true;
+}
+
+Sized_face* Glyph_server::get_face(const std::string& font_file, const int font_size, std::string& error)
+{
+    std::lock_guard<std::mutex> lock {m_faces_mutex};
+    auto it = m_faces.find({font_file, font_size});
+    if(it != m_faces.end()) return it->second.get();
+
+    auto font_it = m_font_files.find(font_file);
+    if(font_it == m_font_files.end()) {
+        std::filesystem::path font_file_path {m_exe_dir};
+        font_file_path.append(font_file);
+        std::ifstream ifs {font_file_path, std::ios_base::binary};
+        if(not ifs) {
+            error = "Failed to open the font file.";
+            return nullptr;
+        }
+        std::vector<uint8> contents {std::istreambuf_iterator<char> {ifs}, std::istreambuf_iterator<char> {}};
+        font_it = m_font_files.emplace(font_file, std::move(contents)).first;
+    }
+
+    auto sized_face = std::make_unique<Sized_face>();
+    sized_face->id = static_cast<uint32>(m_faces.size());
+    const std::vector<uint8>& bytes = font_it->second;
+    if(FT_New_Memory_Face(m_freetype_library, bytes.data(), static_cast<FT_Long>(bytes.size()), 0, &sized_face->face)) {
+        error = "FT_New_Memory_Face failed.";
+        return nullptr;
+    }
+    if(FT_Select_Charmap(sized_face->face, FT_ENCODING_UNICODE)) {
+        FT_Done_Face(sized_face->face);
+        error = "The font file doesn't contain a Unicode character map.";
+        return nullptr;
+    }
+    if(FT_Set_Pixel_Sizes(sized_face->face, 0, font_size)) {
+        FT_Done_Face(sized_face->face);
+        error = "FT_Set_Pixel_Sizes failed.";
+        return nullptr;
+    }
+    return m_faces.emplace(std::make_pair(font_file, font_size), std::move(sized_face)).first->second.get();
+}
+
+std::shared_ptr<const Cached_glyph> Glyph_server::get_glyph(Sized_face& sized_face, const char32_t code_point, const bool sdf)
+{
+    const uint64 key = (static_cast<uint64>(sized_face.id) << 33) | (static_cast<uint64>(sdf) << 32) | code_point;
+    {
+        std::shared_lock<std::shared_mutex> lock {m_cache_mutex};
+        auto it = m_cache.find(key);
+        if(it != m_cache.end()) return it->second;
+    }
+
+    auto glyph = std::make_shared<Cached_glyph>();
+    {
+        std::lock_guard<std::mutex> lock {sized_face.mutex};
+        FT_Face face = sized_face.face;
+        const FT_UInt glyph_index = FT_Get_Char_Index(face, code_point);
+        if(glyph_index == 0u) return nullptr;
+        if(FT_Load_Glyph(face, glyph_index, FT_LOAD_DEFAULT)) return nullptr;
+        if(FT_Render_Glyph(face->glyph, sdf ? FT_RENDER_MODE_SDF : FT_RENDER_MODE_NORMAL)) return nullptr;
+
+        const FT_Bitmap& bitmap = face->glyph->bitmap;
+        glyph->width = bitmap.width;
+        glyph->height = bitmap.rows;
+        glyph->left_bearing = face->glyph->bitmap_left;
+        glyph->top_bearing = face->glyph->bitmap_top;
+        glyph->advance_x = face->glyph->advance.x >> 6;
+        glyph->advance_y = face->glyph->advance.y >> 6;
+        glyph->pixels.resize(static_cast<std::size_t>(glyph->width) * glyph->height);
+        for(int row = 0; row < glyph->height; ++row) {
+            std::memcpy(glyph->pixels.data() + static_cast<std::size_t>(row) * glyph->width, bitmap.buffer + row * bitmap.pitch, glyph->width);
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock {m_cache_mutex};
+    return m_cache.emplace(key, std::move(glyph)).first->second; // another thread may have won the race
+}
+
+bool Glyph_server::answer_glyphs(const std::string& request, std::string& answer)
+{
+    // glyphs <font-size> <sdf> <code points> <font file>
+    const char* str = request.c_str() + 7;
+    char* end = nullptr;
+    const long font_size = std::strtol(str, &end, 10);
+    if(end == str or *end != ' ' or font_size <= 0) {
+        answer = "Invalid font size.";
+        return false;
+    }
+    str = end + 1;
+    const long sdf = std::strtol(str, &end, 10);
+    if(end == str or *end != ' ' or (sdf != 0 and sdf != 1)) {
+        answer = "Invalid sdf value.";
+        return false;
+    }
+    std::vector<char32_t> code_points;
+    do {
+        str = end + 1;
+        const unsigned long code_point = std::strtoul(str, &end, 10);
+        if(end == str or code_point > 0x10FFFFul) {
+            answer = "Invalid code point.";
+            return false;
+        }
+        code_points.push_back(static_cast<char32_t>(code_point));
+    } while(*end == ',');
+    if(*end != ' ' or *(end + 1) == '\0') {
+        answer = "The font file is missing.";
+        return false;
+    }
+
+    Sized_face* sized_face = get_face(std::string {end + 1}, static_cast<int>(font_size), answer);
+    if(not sized_face) return false;
+
+    answer.append("ok ").append(std::to_string(code_points.size())).append(1, '\n');
+    for(const char32_t code_point : code_points) {
+        const std::shared_ptr<const Cached_glyph> glyph = get_glyph(*sized_face, code_point, sdf == 1);
+        answer.append(std::to_string(static_cast<uint32>(code_point)));
+        if(not glyph) {
+            answer.append(":missing\n");
+            continue;
+        }
+        answer.append(1, ':').append(std::to_string(glyph->width));
+        answer.append(1, ':').append(std::to_string(glyph->height));
+        answer.append(1, ':').append(std::to_string(glyph->left_bearing));
+        answer.append(1, ':').append(std::to_string(glyph->top_bearing));
+        answer.append(1, ':').append(std::to_string(glyph->advance_x));
+        answer.append(1, ':').append(std::to_string(glyph->advance_y));
+        answer.append(1, '\n');
+        answer.append(reinterpret_cast<const char*>(glyph->pixels.data()), glyph->pixels.size());
+    }
+    return true;
+}
+
+} // namespace
+
+int run_glyph_server(const std::filesystem::path& exe_dir, const std::string& socket_path)
+{
+    Glyph_server server {exe_dir};
+    if(not server.init()) {
+        std::cerr << "Internal error: FreeType initialisation failed.\n";
+        return EXIT_FAILURE;
+    }
+
+    if(socket_path.empty()) {
+        Standard_streams_connection connection;
+        server.serve(connection);
+        return EXIT_SUCCESS;
+    }
+
+#ifdef __linux__
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(address.sun_path)) {
+        std::cout << "Error: The socket path given to -serve is too long.\n";
+        return EXIT_FAILURE;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size());
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == -1) {
+        std::cout << "Internal error: Couldn't create the socket.\n";
+        return EXIT_FAILURE;
+    }
+    // a socket left by a previous server is replaced, anything else at the path is kept
+    struct stat existing;
+    if(lstat(socket_path.c_str(), &existing) == 0) {
+        if(not S_ISSOCK(existing.st_mode)) {
+            std::cout << "Error: The path given to -serve exists and isn't a socket.\n";
+            close(listener);
+            return EXIT_FAILURE;
+        }
+        unlink(socket_path.c_str());
+    }
+    if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 or listen(listener, 64) == -1) {
+        std::cout << "Error: Couldn't listen on the socket given to -serve.\n";
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    std::cout << "Serving glyph requests on " << socket_path << std::endl;
+
+    /* The main thread polls the idle clients and hands the ones that have sent something to a fixed
+    pool of threads, which answer the requests received so far and give the clients back. So a
+    thread is only busy while it answers, and any number of clients can be connected at once. */
+    int wake_pipe[2];
+    if(pipe(wake_pipe) == -1) {
+        std::cout << "Internal error: Couldn't create a pipe.\n";
+        close(listener);
+        return EXIT_FAILURE;
+    }
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::queue<Socket_connection*> ready; // nullptr stops a thread
+    std::vector<std::pair<Socket_connection*, bool>> handed_back; // and whether the client is still there
+    std::unordered_map<int, std::unique_ptr<Socket_connection>> clients;
+    const unsigned thread_count = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::thread> pool;
+    for(unsigned i = 0; i < thread_count; ++i) {
+        pool.emplace_back([&] {
+            std::string line;
+            std::string answer;
+            while(true) {
+                Socket_connection* connection = nullptr;
+                {
+                    std::unique_lock<std::mutex> lock {queue_mutex};
+                    queue_cv.wait(lock, [&] { return not ready.empty(); });
+                    connection = ready.front();
+                    ready.pop();
+                }
+                if(not connection) return;
+                bool connected = connection->receive();
+                while(connected and connection->next_line(line)) {
+                    connected = server.answer(line, answer) and (answer.empty() or connection->write(answer));
+                }
+                {
+                    std::lock_guard<std::mutex> lock {queue_mutex};
+                    handed_back.emplace_back(connection, connected);
+                }
+                const char byte = 0;
+                if(::write(wake_pipe[1], &byte, 1) == -1) {} // wakes the main thread up, the byte itself means nothing
+            }
+        });
+    }
+
+    std::vector<int> idle;
+    std::vector<pollfd> polled;
+    bool accepting = true; // false while the process is out of file descriptors
+    while(true) {
+        polled.clear();
+        polled.push_back({accepting ? listener : -1, POLLIN, 0}); // poll skips negative descriptors
+        polled.push_back({wake_pipe[0], POLLIN, 0});
+        for(const int fd : idle) polled.push_back({fd, POLLIN, 0});
+        const int ready_count = poll(polled.data(), polled.size(), accepting ? -1 : 1000);
+        if(ready_count == -1) {
+            if(errno == EINTR) continue;
+            std::cerr << "Internal error: poll failed (" << std::strerror(errno) << "), the server stops.\n";
+            break;
+        }
+        if(ready_count == 0) accepting = true; // a second later, try again
+
+        if(polled[1].revents & POLLIN) {
+            char bytes[256];
+            if(read(wake_pipe[0], bytes, sizeof(bytes)) == -1) {}
+            std::lock_guard<std::mutex> lock {queue_mutex};
+            for(const auto& [connection, connected] : handed_back) {
+                if(connected) idle.push_back(connection->fd());
+                else {
+                    clients.erase(connection->fd());
+                    accepting = true; // a descriptor was given back
+                }
+            }
+            handed_back.clear();
+        }
+        for(std::size_t i = 2; i < polled.size(); ++i) {
+            if(polled[i].revents == 0) continue;
+            std::erase(idle, polled[i].fd);
+            std::lock_guard<std::mutex> lock {queue_mutex};
+            ready.push(clients[polled[i].fd].get());
+            queue_cv.notify_one();
+        }
+        if(polled[0].revents & POLLIN) {
+            const int fd = accept(listener, nullptr, nullptr);
+            if(fd != -1) {
+                clients.emplace(fd, std::make_unique<Socket_connection>(fd));
+                idle.push_back(fd);
+                continue;
+            }
+            const int error = errno;
+            if(error == EINTR or error == EAGAIN) continue;
+            // out of descriptors or memory: the listener is left alone until a client leaves or a second passes
+            const bool out_of_resources = error == EMFILE or error == ENFILE or error == ENOBUFS or error == ENOMEM;
+            // the client went away before it was accepted, or a network error that accept reports early
+            const bool client_error = error == ECONNABORTED or error == EPROTO or error == EPERM or error == ENETDOWN or error == ENOPROTOOPT
+                                      or error == EHOSTDOWN or error == ENONET or error == EHOSTUNREACH or error == EOPNOTSUPP or error == ENETUNREACH;
+            if(not out_of_resources and not client_error) {
+                std::cerr << "Internal error: accept failed (" << std::strerror(error) << "), the server stops.\n";
+                break;
+            }
+            std::cerr << "Error: Couldn't accept a client (" << std::strerror(error) << (out_of_resources ? "), new clients wait.\n" : ").\n");
+            if(out_of_resources) accepting = false;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock {queue_mutex};
+        for(unsigned i = 0; i < thread_count; ++i) ready.push(nullptr);
+        queue_cv.notify_all();
+    }
+    for(std::thread& t : pool) t.join();
+    clients.clear();
+    close(wake_pipe[0]);
+    close(wake_pipe[1]);
+    close(listener);
+    unlink(socket_path.c_str());
+    return EXIT_SUCCESS;
+#else
+    std::cout << "Error: Serving over a socket is only supported on Linux, use -serve without a value.\n";
+    return EXIT_FAILURE;
+#endif // __linux__
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+
+/*
+Serves glyph requests until the client (stdin/stdout) or the process (socket) goes away.
+An empty socket path means that the requests come from stdin and the answers go to stdout.
+Font files are searched relative to 'exe_dir', just like -font.
+*/
+int run_glyph_server(const std::filesystem::path& exe_dir, const std::string& socket_path);